@@ -0,0 +1,196 @@
+#include "attendance.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#include <boost/bind.hpp>
+
+// Stack Overflow post,
+// https://stackoverflow.com/questions/306316/determine-if-two-rectangles-overlap-each-other
+
+static bool
+valueInRange(int value, int min, int max)
+{ return (value >= min) && (value <= max); }
+
+bool
+attendance_add_wheelchair(AttendanceState *state, int tracker_id, int x, int y,
+    int w, int h, int zone_id, int64_t now_ms) {
+  auto iter = find_if(state->wheelchair_tracker.begin(), state->wheelchair_tracker.end(), boost::bind(&Wheelie::tracker_id, _1) == tracker_id);
+
+  if (iter != state->wheelchair_tracker.end()) {
+    (*iter).x = x;
+    (*iter).y = y;
+    (*iter).w = w;
+    (*iter).h = h;
+    (*iter).zone_id = zone_id;
+    if ((*iter).reset_cal) {
+      (*iter).wheelchair_bbox_count = 0;
+      (*iter).attendee_counter = 0;
+      (*iter).reset_cal = false;
+    }
+    (*iter).wheelchair_bbox_count++;
+    (*iter).delete_timer_ms = now_ms;
+    return false;
+  }
+
+  Wheelie wl;
+  wl.tracker_id = tracker_id;
+  wl.x = x;
+  wl.y = y;
+  wl.w = w;
+  wl.h = h;
+  wl.zone_id = zone_id;
+  wl.mapped = false;
+  wl.processed_status = false;
+  wl.reset_cal = false;
+  wl.mapped_tracker_id = -1;
+  wl.attendee_counter = 0;
+  wl.wheelchair_bbox_count = 1;
+
+  wl.timer_ms = now_ms;
+  wl.delete_timer_ms = now_ms;
+  state->wheelchair_tracker.emplace_back(wl);
+  return true;
+}
+
+void
+attendance_add_person(AttendanceState *state, int tracker_id, int x, int y,
+    int w, int h) {
+  Attendee a;
+  a.tracker_id = tracker_id;
+  a.x = x;
+  a.y = y;
+  a.w = w;
+  a.h = h;
+  state->attendee_tracker.emplace_back(a);
+}
+
+static void
+map_wheelchair_person(AttendanceState *state) {
+  int w_x, w_y, w_w, w_h;
+  int p_x, p_y, p_w, p_h;
+  for (auto w_it = state->wheelchair_tracker.begin(); w_it != state->wheelchair_tracker.end(); ++w_it) {
+    w_x = (*w_it).x;
+    w_y = (*w_it).y;
+    w_w = (*w_it).w;
+    w_h = (*w_it).h;
+    int mapped_counter = 0;
+    for (auto p_it = state->attendee_tracker.begin(); p_it != state->attendee_tracker.end(); ++p_it) {
+      p_x = (*p_it).x;
+      p_y = (*p_it).y;
+      p_w = (*p_it).w;
+      p_h = (*p_it).h;
+
+      bool xOverlap = valueInRange(w_x, p_x, p_x + p_w) ||
+                      valueInRange(p_x, w_x, w_x + w_w);
+
+      bool yOverlap = valueInRange(w_y, p_y, p_y + p_h) ||
+                      valueInRange(p_y, w_y, w_y + w_h);
+
+
+      // This block maps wheelchair bbox with person bbox and checks for proximity (i.e 200 px)
+      // if any person is within the range a counter is incremented.
+
+      if (xOverlap && yOverlap) {
+        if (abs((p_y + p_h) - (w_y + w_h)) < 200) {
+          mapped_counter++;
+        }
+      }
+    }
+
+    // Here mapped counter is checked for >= 2 due to a bbox from person sitting in wheelchair
+    // along with any other person close to the wheelchair bbox
+    if (mapped_counter >= 2) {
+      (*w_it).mapped = true;
+      (*w_it).attendee_counter++;
+    }
+  }
+}
+
+static void
+validate_wheelchair_attended(AttendanceState *state, int64_t now_ms,
+    std::vector<int>& unattended_ids) {
+  for (auto w_it = state->wheelchair_tracker.begin(); w_it != state->wheelchair_tracker.end(); ) {
+    int64_t diff = now_ms - (*w_it).timer_ms;
+
+    if(diff > 2000) {
+      // calculations are aggregated every 2 seconds and results are computed and a color change is notified as a visual queue
+      bool was_unattended = (*w_it).processed_status &&
+                            attendance_is_unattended(&(*w_it));
+      (*w_it).processed_status = true;
+      (*w_it).reset_cal = true;
+      if ((*w_it).mapped) {
+        if ((((*w_it).attendee_counter/(*w_it).wheelchair_bbox_count) < 0.69) && ((*w_it).wheelchair_bbox_count > 10)) {
+          (*w_it).status = "Unattended";
+        }
+        else {
+          (*w_it).status = "Attended";
+        }
+      }
+      else {
+        (*w_it).status = "Unattended";
+      }
+      if (!was_unattended && attendance_is_unattended(&(*w_it))) {
+        unattended_ids.emplace_back((*w_it).tracker_id);
+      }
+      (*w_it).timer_ms = now_ms;
+    }
+
+    diff = now_ms - (*w_it).delete_timer_ms;
+
+    if (diff > 20000) {
+      w_it = state->wheelchair_tracker.erase(w_it);
+    }
+    else {
+      ++w_it;
+    }
+  }
+}
+
+void
+attendance_process_frame(AttendanceState *state, int64_t now_ms,
+    std::vector<int>& unattended_ids) {
+  map_wheelchair_person(state);
+
+  validate_wheelchair_attended(state, now_ms, unattended_ids);
+
+  state->attendee_tracker.clear();
+}
+
+Wheelie *
+attendance_find_wheelchair(AttendanceState *state, int tracker_id) {
+  auto iter = find_if(state->wheelchair_tracker.begin(), state->wheelchair_tracker.end(), boost::bind(&Wheelie::tracker_id, _1) == tracker_id);
+  if (iter == state->wheelchair_tracker.end()) {
+    return NULL;
+  }
+  return &(*iter);
+}
+
+bool
+attendance_is_unattended(const Wheelie *wheelie) {
+  return wheelie->processed_status && wheelie->status.compare("Unattended") == 0;
+}
+
+void
+attendance_fill_decision(const Wheelie *wheelie, DecisionRecord *record) {
+  record->tracker_id = wheelie->tracker_id;
+  record->x = wheelie->x;
+  record->y = wheelie->y;
+  record->w = wheelie->w;
+  record->h = wheelie->h;
+  record->zone_id = wheelie->zone_id;
+  if (!wheelie->processed_status) {
+    record->status = DECISION_STATUS_PENDING;
+  }
+  else if (wheelie->status.compare("Unattended") == 0) {
+    record->status = DECISION_STATUS_UNATTENDED;
+  }
+  else {
+    record->status = DECISION_STATUS_ATTENDED;
+  }
+  record->ratio = 0;
+  if (wheelie->wheelchair_bbox_count > 0) {
+    record->ratio = (float) wheelie->attendee_counter / wheelie->wheelchair_bbox_count;
+  }
+}
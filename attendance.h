@@ -0,0 +1,77 @@
+#ifndef ATTENDANCE_H
+#define ATTENDANCE_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "decision_feed.h"
+
+/* Wheelchair attendance analytics.
+ *
+ * Wheelchair and person detections of a frame are fed in, then the frame is
+ * processed: every wheelchair is matched against the people around it and,
+ * every two seconds, its attended status is decided from how often it was
+ * accompanied. All the state lives in an AttendanceState and time is passed
+ * in by the caller, so the live app can run on the wall clock while offline
+ * re-analysis runs many independent states on trace timestamps. */
+
+/* gie-unique-id of the detectors and the class ids the analytics use. */
+#define PGIE_COMPONENT_ID 1
+#define SGIE_COMPONENT_ID 2
+#define PGIE_CLASS_ID_PERSON 0
+#define SGIE_CLASS_ID_WHEELCHAIR 0
+
+struct Wheelie{
+  int x, y, w, h;
+  bool mapped;
+  bool processed_status;
+  bool reset_cal;
+  int tracker_id;
+  int mapped_tracker_id;
+  int attendee_counter;
+  int wheelchair_bbox_count;
+  int zone_id;
+  std::string status;
+  int64_t timer_ms;
+  int64_t delete_timer_ms;
+};
+
+struct Attendee{
+  int x, y, w, h;
+  int tracker_id;
+};
+
+struct AttendanceState {
+  std::vector<Wheelie> wheelchair_tracker;
+  std::vector<Attendee> attendee_tracker;
+};
+
+/* Adds a wheelchair detection to the current frame. Returns true if this is
+ * the first time the tracker id is seen. */
+bool
+attendance_add_wheelchair(AttendanceState *state, int tracker_id, int x, int y,
+    int w, int h, int zone_id, int64_t now_ms);
+
+void
+attendance_add_person(AttendanceState *state, int tracker_id, int x, int y,
+    int w, int h);
+
+/* Processes the detections added since the last call. Tracker ids of
+ * wheelchairs that turned unattended are appended to `unattended_ids`. */
+void
+attendance_process_frame(AttendanceState *state, int64_t now_ms,
+    std::vector<int>& unattended_ids);
+
+Wheelie *
+attendance_find_wheelchair(AttendanceState *state, int tracker_id);
+
+bool
+attendance_is_unattended(const Wheelie *wheelie);
+
+/* Fills the per-track fields of a decision record, the caller sets the frame
+ * fields (pts, frame_num, source_id). */
+void
+attendance_fill_decision(const Wheelie *wheelie, DecisionRecord *record);
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>
+
+/* Minimal assertions for the standalone checks run by `make check`. A failed
+ * CHECK is reported and counted, and the check goes on; main() returns
+ * check_result() so any failure fails the run. */
+
+static int check_failures = 0;
+
+#define CHECK(cond)                                                      \
+  do {                                                                   \
+    if (!(cond)) {                                                       \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      check_failures++;                                                  \
+    }                                                                    \
+  } while (0)
+
+static inline int
+check_result(const char *name) {
+  if (check_failures) {
+    fprintf(stderr, "%s: %d failures\n", name, check_failures);
+    return 1;
+  }
+  printf("%s: ok\n", name);
+  return 0;
+}
+
+#endif
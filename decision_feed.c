@@ -0,0 +1,250 @@
+#include "decision_feed.h"
+
+#include <atomic>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct alignas(64) FeedHeader {
+  std::atomic<uint32_t> magic;
+  uint32_t version;
+  uint32_t capacity;
+  uint32_t record_size;
+  // Sequence number of the next record to be published.
+  alignas(64) std::atomic<uint64_t> head;
+};
+
+// A slot's seq is 2 * n + 1 while record n is being written into it and
+// 2 * n + 2 once it is complete.
+struct alignas(64) FeedSlot {
+  std::atomic<uint64_t> seq;
+  DecisionRecord record;
+};
+
+struct DecisionFeed {
+  FeedHeader *header;
+  FeedSlot *slots;
+  uint32_t mask;
+  size_t size;
+  char name[64];
+};
+
+struct DecisionFeedReader {
+  const FeedHeader *header;
+  const FeedSlot *slots;
+  uint32_t capacity;
+  uint32_t mask;
+  size_t size;
+  uint64_t cursor;
+  // Kept open to notice the segment being unlinked by a new writer.
+  int fd;
+};
+
+static size_t
+feed_size(uint32_t capacity) {
+  return sizeof(FeedHeader) + (size_t) capacity * sizeof(FeedSlot);
+}
+
+DecisionFeed *
+decision_feed_create(const char *name, uint32_t capacity) {
+  if (capacity == 0 || (capacity & (capacity - 1)) != 0) {
+    fprintf(stderr, "Decision feed capacity %u is not a power of two\n", capacity);
+    return NULL;
+  }
+
+  // Start from a fresh segment rather than reinitialising a ring readers of a
+  // previous run may still be attached to. They see it unlinked and report
+  // the feed closed.
+  shm_unlink(name);
+  int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+  if (fd < 0) {
+    perror("decision feed shm_open");
+    return NULL;
+  }
+
+  size_t size = feed_size(capacity);
+  if (ftruncate(fd, size) != 0) {
+    perror("decision feed ftruncate");
+    close(fd);
+    shm_unlink(name);
+    return NULL;
+  }
+
+  void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    perror("decision feed mmap");
+    shm_unlink(name);
+    return NULL;
+  }
+
+  // Plain C allocation keeps the client library free of libstdc++, so C
+  // readers can link it without a C++ runtime.
+  DecisionFeed *feed = (DecisionFeed *) calloc(1, sizeof(DecisionFeed));
+  if (!feed) {
+    munmap(base, size);
+    shm_unlink(name);
+    return NULL;
+  }
+  feed->header = (FeedHeader *) base;
+  feed->slots = (FeedSlot *) ((char *) base + sizeof(FeedHeader));
+  feed->mask = capacity - 1;
+  feed->size = size;
+  snprintf(feed->name, sizeof(feed->name), "%s", name);
+
+  feed->header->version = DECISION_FEED_VERSION;
+  feed->header->capacity = capacity;
+  feed->header->record_size = sizeof(DecisionRecord);
+  feed->header->head.store(0, std::memory_order_relaxed);
+  for (uint32_t i = 0; i < capacity; i++) {
+    feed->slots[i].seq.store(0, std::memory_order_relaxed);
+  }
+  feed->header->magic.store(DECISION_FEED_MAGIC, std::memory_order_release);
+
+  return feed;
+}
+
+void
+decision_feed_publish(DecisionFeed *feed, const DecisionRecord *record) {
+  if (!feed) {
+    return;
+  }
+
+  uint64_t n = feed->header->head.load(std::memory_order_relaxed);
+  FeedSlot *slot = &feed->slots[n & feed->mask];
+
+  slot->seq.store(2 * n + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  memcpy(&slot->record, record, sizeof(DecisionRecord));
+  slot->seq.store(2 * n + 2, std::memory_order_release);
+
+  feed->header->head.store(n + 1, std::memory_order_release);
+}
+
+void
+decision_feed_destroy(DecisionFeed *feed) {
+  if (!feed) {
+    return;
+  }
+
+  feed->header->magic.store(0, std::memory_order_release);
+  munmap(feed->header, feed->size);
+  shm_unlink(feed->name);
+  free(feed);
+}
+
+DecisionFeedReader *
+decision_feed_reader_open(const char *name) {
+  int fd = shm_open(name, O_RDONLY, 0);
+  if (fd < 0) {
+    return NULL;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(FeedHeader)) {
+    close(fd);
+    return NULL;
+  }
+
+  void *base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (base == MAP_FAILED) {
+    close(fd);
+    return NULL;
+  }
+
+  const FeedHeader *header = (const FeedHeader *) base;
+  uint32_t capacity = header->capacity;
+  if (header->magic.load(std::memory_order_acquire) != DECISION_FEED_MAGIC ||
+      header->version != DECISION_FEED_VERSION ||
+      header->record_size != sizeof(DecisionRecord) ||
+      capacity == 0 || (capacity & (capacity - 1)) != 0 ||
+      feed_size(capacity) > (size_t) st.st_size) {
+    munmap(base, st.st_size);
+    close(fd);
+    return NULL;
+  }
+
+  DecisionFeedReader *reader = (DecisionFeedReader *) calloc(1, sizeof(DecisionFeedReader));
+  if (!reader) {
+    munmap(base, st.st_size);
+    close(fd);
+    return NULL;
+  }
+  reader->header = header;
+  reader->slots = (const FeedSlot *) ((const char *) base + sizeof(FeedHeader));
+  reader->capacity = capacity;
+  reader->mask = capacity - 1;
+  reader->size = st.st_size;
+  reader->cursor = header->head.load(std::memory_order_acquire);
+  reader->fd = fd;
+  return reader;
+}
+
+/* The writer clears the magic when it shuts down, and a restarted writer
+ * unlinks the old segment before creating its own. */
+static bool
+reader_feed_closed(DecisionFeedReader *reader) {
+  if (reader->header->magic.load(std::memory_order_acquire) != DECISION_FEED_MAGIC) {
+    return true;
+  }
+  struct stat st;
+  return fstat(reader->fd, &st) != 0 || st.st_nlink == 0;
+}
+
+int
+decision_feed_reader_next(DecisionFeedReader *reader, DecisionRecord *record,
+    uint64_t *lost) {
+  for (;;) {
+    uint64_t head = reader->header->head.load(std::memory_order_acquire);
+    if (reader->cursor >= head) {
+      // Only checked once caught up, records still in the ring of a feed
+      // that just closed are delivered first.
+      return reader_feed_closed(reader) ? -1 : 0;
+    }
+
+    // Everything older than one ring behind the head is gone already.
+    if (head - reader->cursor > reader->capacity) {
+      if (lost) {
+        *lost += head - reader->capacity - reader->cursor;
+      }
+      reader->cursor = head - reader->capacity;
+    }
+
+    const FeedSlot *slot = &reader->slots[reader->cursor & reader->mask];
+    uint64_t expected = 2 * reader->cursor + 2;
+
+    uint64_t before = slot->seq.load(std::memory_order_acquire);
+    if (before == expected) {
+      memcpy(record, &slot->record, sizeof(DecisionRecord));
+      std::atomic_thread_fence(std::memory_order_acquire);
+      uint64_t after = slot->seq.load(std::memory_order_relaxed);
+      if (after == expected) {
+        reader->cursor++;
+        return 1;
+      }
+    }
+
+    // The writer lapped us while we were looking at this slot, drop it and
+    // retry from wherever the head is now.
+    if (lost) {
+      (*lost)++;
+    }
+    reader->cursor++;
+  }
+}
+
+void
+decision_feed_reader_close(DecisionFeedReader *reader) {
+  if (!reader) {
+    return;
+  }
+
+  munmap((void *) reader->header, reader->size);
+  close(reader->fd);
+  free(reader);
+}
@@ -0,0 +1,81 @@
+#ifndef DECISION_FEED_H
+#define DECISION_FEED_H
+
+#include <stdint.h>
+
+/* Shared-memory feed of per-track decisions.
+ *
+ * The app is the only writer. It publishes one record per wheelchair track
+ * per frame into a fixed-size ring in POSIX shared memory and never waits on
+ * anyone. Any number of local readers map the same ring read-only and follow
+ * it with their own cursor. Each slot carries a sequence number, so a reader
+ * that falls more than a ring behind detects that it was overwritten, skips
+ * ahead and reports how many records it lost. */
+
+#define DECISION_FEED_NAME "/mobilityaids-decisions"
+#define DECISION_FEED_MAGIC 0x4d414446u /* "MADF" */
+#define DECISION_FEED_VERSION 2
+
+/* Number of slots, must be a power of two. */
+#define DECISION_FEED_CAPACITY 4096
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum DecisionStatus {
+  DECISION_STATUS_PENDING = 0,
+  DECISION_STATUS_ATTENDED = 1,
+  DECISION_STATUS_UNATTENDED = 2
+} DecisionStatus;
+
+typedef struct DecisionRecord {
+  uint64_t pts;
+  uint64_t frame_num;
+  uint32_t source_id;
+  int32_t tracker_id;
+  int32_t x, y, w, h;
+  int32_t status;
+  float ratio;
+  uint32_t zone_id;
+} DecisionRecord;
+
+typedef struct DecisionFeed DecisionFeed;
+typedef struct DecisionFeedReader DecisionFeedReader;
+
+/* Writer side, used by the app. */
+DecisionFeed *
+decision_feed_create(const char *name, uint32_t capacity);
+
+void
+decision_feed_publish(DecisionFeed *feed, const DecisionRecord *record);
+
+void
+decision_feed_destroy(DecisionFeed *feed);
+
+/* Reader side, the client library for downstream consumers. A new reader
+ * starts at the current head of the ring and only sees records published
+ * after it was opened. */
+DecisionFeedReader *
+decision_feed_reader_open(const char *name);
+
+/* Copies the next record into `record` and returns 1, or returns 0 if the
+ * reader has caught up with the writer. `lost` is incremented by the number
+ * of records that were overwritten before this reader got to them.
+ *
+ * Returns -1 once the feed is closed: the writer shut down, or a restarted
+ * writer replaced the segment this reader is attached to. The reader should
+ * then be closed and, to follow a new run, opened again. A writer that
+ * crashed and was not restarted cannot be told apart from an idle one. */
+int
+decision_feed_reader_next(DecisionFeedReader *reader, DecisionRecord *record,
+    uint64_t *lost);
+
+void
+decision_feed_reader_close(DecisionFeedReader *reader);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
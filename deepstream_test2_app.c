@@ -29,23 +29,33 @@
 #include <vector>
 #include <algorithm>
 #include <iostream>
+#include <map>
+#include <set>
+#include <chrono>
 
-#include <boost/bind.hpp>
 #include <boost/chrono.hpp>
 
 #include "gstnvdsmeta.h"
+#include "nvbufsurface.h"
+
+#include "decision_feed.h"
+#include "zone_mask.h"
+#include "snapshot_pool.h"
+#include "latency_policy.h"
+#include "attendance.h"
+#include "detection_trace.h"
+#include "occupancy_store.h"
+#include "overlay_builder.h"
 
 #define PGIE_CONFIG_FILE  "dstest2_pgie_config.txt"
 #define SGIE_CONFIG_FILE  "dstest2_sgie_config.txt"
 
-#define MAX_DISPLAY_LEN 64
-
 #define TRACKER_CONFIG_FILE "dstest2_tracker_config.txt"
+#define ZONES_CONFIG_FILE "dstest2_zones_config.txt"
+#define PIPELINE_CONFIG_FILE "dstest2_pipeline_config.txt"
 #define MAX_TRACKING_ID_LEN 16
 
 #define PGIE_CLASS_ID_VEHICLE 0
-#define PGIE_CLASS_ID_PERSON 0
-#define SGIE_CLASS_ID_WHEELCHAIR 0
 
 /* The muxer output resolution must be set if the input streams will be of
  * different resolution. The muxer will scale all the input frames to this
@@ -59,156 +69,216 @@
 
 #define GST_CAPS_FEATURES_NVMM "memory:NVMM"
 
-struct Wheelie{
-  int x, y, w, h;
-  bool mapped;
-  bool processed_status;
-  bool reset_cal;
-  int tracker_id;
-  int mapped_tracker_id;
-  int attendee_counter;
-  int wheelchair_bbox_count;
-  std::string status;
-  std::chrono::system_clock::time_point timer;
-  std::chrono::system_clock::time_point delete_timer;
-};
-
-struct Attendee{
-  int x, y, w, h;
-  int tracker_id;
-};
+/* A snapshot of every wheelchair that turns unattended is written to this
+ * directory if it exists. Crops are the bbox plus margin, clipped to at most
+ * SNAPSHOT_MAX_WIDTH x SNAPSHOT_MAX_HEIGHT, and at most SNAPSHOT_POOL_SIZE of
+ * them wait for the encoder at any time. */
+#define SNAPSHOT_DIR "snapshots"
+#define SNAPSHOT_POOL_SIZE 8
+#define SNAPSHOT_MAX_WIDTH 640
+#define SNAPSHOT_MAX_HEIGHT 640
+#define SNAPSHOT_MARGIN 32
+
+/* The detections of every source are recorded to TRACE_DIR/source<id>.trace
+ * if the directory exists, for offline re-analysis with offline-runner. */
+#define TRACE_DIR "traces"
+
+/* Per-source occupancy history is snapshotted to this file periodically. */
+#define OCCUPANCY_SNAPSHOT_FILE "occupancy.bin"
+#define OCCUPANCY_SNAPSHOT_INTERVAL_SEC 60
+
+/* Inter-stage queue defaults, overridden by PIPELINE_CONFIG_FILE. Leaky is
+ * passed to the queues as is: 0 blocks when full, 1 drops the new buffer and
+ * 2 drops the oldest one. A latency budget of 0 disables dropping batches
+ * before inference. */
+#define QUEUE_MAX_SIZE_BUFFERS 4
+#define QUEUE_LEAKY 0
+#define LATENCY_BUDGET_MSEC 0
 
 using namespace std;
 
-Wheelie wl;
-Attendee a;
-
-std::vector<Wheelie> wheelchair_tracker;
-std::vector<Attendee> attendee_tracker;
+AttendanceState attendance;
 
 gint frame_number = 0;
 
+DecisionFeed *decision_feed = NULL;
+SnapshotPool *snapshot_pool = NULL;
+// Unattended wheelchairs waiting to be detected again to be cropped.
+std::set<int> pending_snapshot_ids;
 
-// Stack Overflow post,
-// https://stackoverflow.com/questions/306316/determine-if-two-rectangles-overlap-each-other
+GstElement *pipeline_element = NULL;
+std::vector<GstElement *> stage_queues;
+LatencyPolicy latency_policy;
 
-bool
-valueInRange(int value, int min, int max)
-{ return (value >= min) && (value <= max); }
+OccupancyStore occupancy_store;
+OverlayBuilder overlay_builder;
 
-static void
-map_wheelchair_person() {
-  int w_x, w_y, w_w, w_h;
-  int p_x, p_y, p_w, p_h;
-  for (auto w_it = wheelchair_tracker.begin(); w_it != wheelchair_tracker.end(); ++w_it) {
-    w_x = (*w_it).x;
-    w_y = (*w_it).y;
-    w_w = (*w_it).w;
-    w_h = (*w_it).h;
-    int mapped_counter = 0;
-    for (auto p_it = attendee_tracker.begin(); p_it != attendee_tracker.end(); ++p_it) {
-      p_x = (*p_it).x;
-      p_y = (*p_it).y;
-      p_w = (*p_it).w;
-      p_h = (*p_it).h;
-
-      bool xOverlap = valueInRange(w_x, p_x, p_x + p_w) ||
-                      valueInRange(p_x, w_x, w_x + w_w);
-
-      bool yOverlap = valueInRange(w_y, p_y, p_y + p_h) ||
-                      valueInRange(p_y, w_y, w_y + w_h);
-
-
-      // This block maps wheelchair bbox with person bbox and checks for proximity (i.e 200 px)
-      // if any person is within the range a counter is incremented.
-
-      if (xOverlap && yOverlap) {
-        if (abs((p_y + p_h) - (w_y + w_h)) < 200) {
-          mapped_counter++;
-        }
-      }
-    }
+bool record_traces = false;
+std::map<guint, FILE *> trace_files;
 
-    // Here mapped counter is checked for >= 2 due to a bbox from person sitting in wheelchair
-    // along with any other person close to the wheelchair bbox
-    if (mapped_counter >= 2) {
-      (*w_it).mapped = true;
-      (*w_it).attendee_counter++;
-    }
+// Rasterised zones per source id. Sources without an entry have no zones
+// configured and all their detections are kept.
+std::map<guint, ZoneMask> zone_masks;
+
+
+static int64_t
+wall_clock_ms() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>
+    (std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+/* Trace file of a source, opened the first time the source is seen. */
+static FILE *
+get_trace_file(guint source_id) {
+  auto trace_it = trace_files.find(source_id);
+  if (trace_it != trace_files.end()) {
+    return trace_it->second;
   }
+
+  gchar path[PATH_MAX];
+  g_snprintf(path, sizeof(path), "%s/source%u.trace", TRACE_DIR, source_id);
+  FILE *trace = detection_trace_create(path);
+  if (!trace) {
+    g_printerr("Failed to create trace file %s\n", path);
+  }
+  trace_files[source_id] = trace;
+  return trace;
 }
 
+/* Publish the current decision for every wheelchair seen in this frame to the
+ * shared-memory feed. Readers are never waited on, so this costs the streaming
+ * thread a few stores per track. */
 static void
-validate_wheelchair_attended() {
-  for (auto w_it = wheelchair_tracker.begin(); w_it != wheelchair_tracker.end(); ++w_it) {
-    auto diff = std::chrono::duration_cast<std::chrono::milliseconds>
-    (std::chrono::system_clock::now() - (*w_it).timer).count();
-
-    if(diff > 2000) {
-      // calculations are aggregated every 2 seconds and results are computed and a color change is notified as a visual queue
-      (*w_it).processed_status = true;
-      (*w_it).reset_cal = true;
-      if ((*w_it).mapped) {
-        if ((((*w_it).attendee_counter/(*w_it).wheelchair_bbox_count) < 0.69) && ((*w_it).wheelchair_bbox_count > 10)) {
-          (*w_it).status = "Unattended";
-        }
-        else {
-          (*w_it).status = "Attended";
-        }
-      }
-      else {
-        (*w_it).status = "Unattended";
-      }
-      (*w_it).timer = std::chrono::system_clock::now();
+publish_decisions(NvDsFrameMeta* frame_meta, const std::vector<int>& seen_ids) {
+  if (!decision_feed) {
+    return;
+  }
+
+  DecisionRecord record;
+  for (auto id_it = seen_ids.begin(); id_it != seen_ids.end(); ++id_it) {
+    Wheelie *wheelie = attendance_find_wheelchair(&attendance, *id_it);
+    if (!wheelie) {
+      continue;
     }
 
-    diff = std::chrono::duration_cast<std::chrono::milliseconds>
-    (std::chrono::system_clock::now() - (*w_it).delete_timer).count();
+    memset(&record, 0, sizeof(record));
+    record.pts = frame_meta->buf_pts;
+    record.frame_num = frame_meta->frame_num;
+    record.source_id = frame_meta->source_id;
+    attendance_fill_decision(wheelie, &record);
+    decision_feed_publish(decision_feed, &record);
+  }
+}
 
-    if (diff > 20000) {
-      wheelchair_tracker.erase(w_it);
-      --w_it;
+/* Adds this frame's counts to the source's occupancy history. */
+static void
+update_occupancy(NvDsFrameMeta* frame_meta, int64_t now_ms, guint person_count,
+    const std::vector<int>& seen_ids) {
+  uint32_t values[OCCUPANCY_NUM_METRICS] = { 0 };
+
+  values[OCCUPANCY_PEOPLE] = person_count;
+  values[OCCUPANCY_WHEELCHAIRS] = seen_ids.size();
+  for (auto id_it = seen_ids.begin(); id_it != seen_ids.end(); ++id_it) {
+    Wheelie *wheelie = attendance_find_wheelchair(&attendance, *id_it);
+    if (!wheelie || !wheelie->processed_status) {
+      continue;
+    }
+    if (attendance_is_unattended(wheelie)) {
+      values[OCCUPANCY_UNATTENDED]++;
+    }
+    else {
+      values[OCCUPANCY_ATTENDED]++;
     }
   }
+
+  occupancy_store_update(&occupancy_store, frame_meta->source_id,
+      now_ms / 1000, values);
 }
 
-void
-set_object_color(NvDsFrameMeta* frame_meta) {
-  for (NvDsMetaList * l_obj = frame_meta->obj_meta_list; l_obj != NULL;
-      l_obj = l_obj->next) {
+static gboolean
+write_occupancy_snapshot (gpointer data)
+{
+  if (!occupancy_store_write_snapshot (&occupancy_store, OCCUPANCY_SNAPSHOT_FILE))
+    g_printerr ("Failed to write %s\n", OCCUPANCY_SNAPSHOT_FILE);
+  return TRUE;
+}
 
-      NvDsObjectMeta *obj_meta = (NvDsObjectMeta *) l_obj->data;
+/* Hand a crop of every wheelchair that turned unattended to the snapshot
+ * pool. Tracks outlive their detections and are re-evaluated whether or not
+ * they were detected, so a wheelchair is only cropped in a frame it was
+ * detected in; the stored bbox of any other one may show empty floor. Until
+ * then its event waits in pending_snapshot_ids. Tracker ids are unique across
+ * sources, as the attendance state already assumes, so being detected also
+ * means this is the wheelchair's own source. Events whose track is deleted or
+ * turns attended again first are counted as not visible. Frames the CPU can
+ * not read as RGBA count as bad crops. */
+static void
+capture_unattended_snapshots(NvBufSurface* surface, NvDsFrameMeta* frame_meta,
+    const std::vector<int>& unattended_ids,
+    const std::vector<int>& seen_wheelchair_ids) {
+  if (!snapshot_pool) {
+    return;
+  }
 
-      if (obj_meta == NULL) {
-        // Ignore Null object.
-        continue;
-      }
+  pending_snapshot_ids.insert(unattended_ids.begin(), unattended_ids.end());
 
-      int class_index = obj_meta->class_id;
-      int cur_obj_id = obj_meta->object_id;
-
-      for (auto iter = wheelchair_tracker.begin(); iter != wheelchair_tracker.end(); ++iter) {
-        if ((*iter).tracker_id == cur_obj_id) {
-          if ((*iter).processed_status) {
-            if ((*iter).status.compare("Unattended") == 0) {
-              #ifndef PLATFORM_TEGRA
-                obj_meta->rect_params.has_bg_color = 1;
-                obj_meta->rect_params.bg_color.red = 1;
-                obj_meta->rect_params.bg_color.green = 0;
-                obj_meta->rect_params.bg_color.blue = 0;
-                obj_meta->rect_params.bg_color.alpha = 0.2;
-              #endif
-              obj_meta->rect_params.border_width = 8;
-              obj_meta->rect_params.border_color.red = 1;
-              obj_meta->rect_params.border_color.green = 0;
-              obj_meta->rect_params.border_color.blue = 0;
-              obj_meta->rect_params.border_color.alpha = 0.2;
-              obj_meta->text_params.font_params.font_size = 14;
-            }
-          }
+  std::vector<Wheelie *> due;
+  for (auto id_it = pending_snapshot_ids.begin(); id_it != pending_snapshot_ids.end(); ) {
+    Wheelie *wheelie = attendance_find_wheelchair(&attendance, *id_it);
+    if (!wheelie || !attendance_is_unattended(wheelie)) {
+      snapshot_pool_drop_not_visible(snapshot_pool);
+      id_it = pending_snapshot_ids.erase(id_it);
+    }
+    else if (std::find(seen_wheelchair_ids.begin(), seen_wheelchair_ids.end(),
+        *id_it) != seen_wheelchair_ids.end()) {
+      due.emplace_back(wheelie);
+      id_it = pending_snapshot_ids.erase(id_it);
+    }
+    else {
+      ++id_it;
+    }
+  }
+  if (due.empty()) {
+    return;
+  }
+
+  NvBufSurfaceParams *params = NULL;
+  const uint8_t *pixels = NULL;
+  bool mapped = false;
+  if (surface && frame_meta->batch_id < surface->numFilled) {
+    params = &surface->surfaceList[frame_meta->batch_id];
+  }
+  if (params && params->colorFormat == NVBUF_COLOR_FORMAT_RGBA) {
+    switch (surface->memType) {
+      case NVBUF_MEM_SYSTEM:
+      case NVBUF_MEM_CUDA_PINNED:
+      case NVBUF_MEM_CUDA_UNIFIED:
+        pixels = (const uint8_t *) params->dataPtr;
+        break;
+      case NVBUF_MEM_SURFACE_ARRAY:
+        if (NvBufSurfaceMap(surface, frame_meta->batch_id, 0, NVBUF_MAP_READ) == 0) {
+          NvBufSurfaceSyncForCpu(surface, frame_meta->batch_id, 0);
+          pixels = (const uint8_t *) params->mappedAddr.addr[0];
+          mapped = true;
         }
-      }
+        break;
+      default:
+        break;
     }
+  }
+
+  for (auto w_it = due.begin(); w_it != due.end(); ++w_it) {
+    Wheelie *wheelie = *w_it;
+    snapshot_pool_submit(snapshot_pool, pixels,
+        params ? params->width : 0, params ? params->height : 0,
+        params ? params->pitch : 0, wheelie->x, wheelie->y, wheelie->w,
+        wheelie->h, SNAPSHOT_MARGIN, frame_meta->source_id,
+        wheelie->tracker_id, frame_meta->buf_pts);
+  }
+
+  if (mapped) {
+    NvBufSurfaceUnMap(surface, frame_meta->batch_id, 0);
+  }
 }
 
 /* This is the buffer probe function that we have registered on the sink pad
@@ -220,21 +290,44 @@ osd_sink_pad_buffer_probe (GstPad * pad, GstPadProbeInfo * info,
     gpointer u_data)
 {
     GstBuffer *buf = (GstBuffer *) info->data;
-    guint num_rects = 0;
     NvDsObjectMeta *obj_meta = NULL;
-    guint vehicle_count = 0;
-    guint person_count = 0;
     NvDsMetaList * l_frame = NULL;
     NvDsMetaList * l_obj = NULL;
-    NvDsDisplayMeta *display_meta = NULL;
+    std::vector<NvDsObjectMeta *> wheelchair_metas;
 
     NvDsBatchMeta *batch_meta = gst_buffer_get_nvds_batch_meta (buf);
 
+    GstMapInfo in_map_info;
+    NvBufSurface *surface = NULL;
+    memset (&in_map_info, 0, sizeof (in_map_info));
+    if (snapshot_pool && gst_buffer_map (buf, &in_map_info, GST_MAP_READ)) {
+      surface = (NvBufSurface *) in_map_info.data;
+    }
+
     for (l_frame = batch_meta->frame_meta_list; l_frame != NULL;
       l_frame = l_frame->next) {
         NvDsFrameMeta *frame_meta = (NvDsFrameMeta *) (l_frame->data);
-        int offset = 0;
-        std::vector<int> wheelchair_ids;
+        guint vehicle_count = 0;
+        guint person_count = 0;
+        int64_t now_ms = wall_clock_ms();
+        std::vector<int> seen_wheelchair_ids;
+        wheelchair_metas.clear();
+
+        FILE *trace = NULL;
+        if (record_traces) {
+          TraceFrame trace_frame = {frame_meta->source_id,
+              (uint64_t) frame_meta->frame_num, frame_meta->buf_pts};
+          trace = get_trace_file(frame_meta->source_id);
+          if (trace) {
+            detection_trace_write_frame(trace, &trace_frame);
+          }
+        }
+
+        const ZoneMask *zone_mask = NULL;
+        auto zone_it = zone_masks.find(frame_meta->source_id);
+        if (zone_it != zone_masks.end()) {
+          zone_mask = &zone_it->second;
+        }
         for (l_obj = frame_meta->obj_meta_list; l_obj != NULL;
                 l_obj = l_obj->next) {
             obj_meta = (NvDsObjectMeta *) (l_obj->data);
@@ -248,108 +341,199 @@ osd_sink_pad_buffer_probe (GstPad * pad, GstPadProbeInfo * info,
 
             cur_obj_id = obj_meta->object_id;
 
-            if ((obj_meta->unique_component_id == 2) && (obj_meta->class_id == SGIE_CLASS_ID_WHEELCHAIR)) {
+            // Detections whose foot point lies outside every configured zone
+            // are not tracked any further. Boxes clipped by the frame edge,
+            // typically people close to the camera, put their foot point on
+            // or past the edge, so it is clamped into the frame.
+            int zone_id = ZONE_NONE;
+            if (zone_mask) {
+              int foot_x = CLAMP (x + wt / 2, 0, MUXER_OUTPUT_WIDTH - 1);
+              int foot_y = CLAMP (y + ht, 0, MUXER_OUTPUT_HEIGHT - 1);
+              zone_id = zone_mask_lookup(zone_mask, foot_x, foot_y);
+              if (zone_id == ZONE_NONE) {
+                continue;
+              }
+            }
+
+            if (trace) {
+              TraceObject trace_object = {obj_meta->unique_component_id,
+                  obj_meta->class_id, cur_obj_id, x, y, wt, ht, zone_id};
+              detection_trace_write_object(trace, &trace_object);
+            }
+
+            if ((obj_meta->unique_component_id == SGIE_COMPONENT_ID) && (obj_meta->class_id == SGIE_CLASS_ID_WHEELCHAIR)) {
                 vehicle_count++;
 
-                #ifndef PLATFORM_TEGRA
-                  obj_meta->rect_params.has_bg_color = 1;
-                  obj_meta->rect_params.bg_color.red = 0;
-                  obj_meta->rect_params.bg_color.green = 1;
-                  obj_meta->rect_params.bg_color.blue = 0;
-                  obj_meta->rect_params.bg_color.alpha = 0.2;
-                #endif
-                obj_meta->rect_params.border_width = 8;
-                obj_meta->rect_params.border_color.red = 0;
-                obj_meta->rect_params.border_color.green = 1;
-                obj_meta->rect_params.border_color.blue = 0;
-                obj_meta->rect_params.border_color.alpha = 0.2;
-                obj_meta->text_params.font_params.font_size = 14;
-
-                wl.tracker_id = cur_obj_id;
-                wl.x = x;
-                wl.y = y;
-                wl.w = wt;
-                wl.h = ht;
-
-                auto iter = find_if(wheelchair_tracker.begin(), wheelchair_tracker.end(), boost::bind(&Wheelie::tracker_id, _1) == cur_obj_id);
-
-                if (iter != wheelchair_tracker.end()) {
-                  (*iter).x = x;
-                  (*iter).y = y;
-                  (*iter).w = wt;
-                  (*iter).h = ht;
-                  if ((*iter).reset_cal) {
-                    (*iter).wheelchair_bbox_count = 0;
-                    (*iter).attendee_counter = 0;
-                    (*iter).reset_cal = false;
-                  }
-                  (*iter).wheelchair_bbox_count++;
-                  (*iter).delete_timer = std::chrono::system_clock::now();
-                }
-                else {
-                  wl.mapped = false;
-                  wl.mapped_tracker_id = -1;
-                  wl.wheelchair_bbox_count = 1;
-
-                  wl.timer = std::chrono::system_clock::now();
-                  wl.delete_timer = std::chrono::system_clock::now();
-                  wheelchair_tracker.emplace_back(wl);
-                  wheelchair_ids.emplace_back(cur_obj_id);
-                }
+                seen_wheelchair_ids.emplace_back(cur_obj_id);
+                wheelchair_metas.emplace_back(obj_meta);
+
+                attendance_add_wheelchair(&attendance, cur_obj_id, x, y, wt, ht,
+                    zone_id, now_ms);
             }
-            if ((obj_meta->unique_component_id == 1) && obj_meta->class_id == PGIE_CLASS_ID_PERSON) {
+            if ((obj_meta->unique_component_id == PGIE_COMPONENT_ID) && obj_meta->class_id == PGIE_CLASS_ID_PERSON) {
                 person_count++;
 
-                a.tracker_id = cur_obj_id;
-                a.x = x;
-                a.y = y;
-                a.w = wt;
-                a.h = ht;
-                attendee_tracker.emplace_back(a);
+                attendance_add_person(&attendance, cur_obj_id, x, y, wt, ht);
             }
         }
 
-        map_wheelchair_person();
-
-        validate_wheelchair_attended();
+        std::vector<int> unattended_ids;
+        attendance_process_frame(&attendance, now_ms, unattended_ids);
 
-        attendee_tracker.clear();
+        capture_unattended_snapshots(surface, frame_meta, unattended_ids,
+            seen_wheelchair_ids);
 
-        set_object_color(frame_meta);
+        publish_decisions(frame_meta, seen_wheelchair_ids);
 
-        display_meta = nvds_acquire_display_meta_from_pool(batch_meta);
-        NvOSD_TextParams *txt_params  = display_meta->text_params;
-        display_meta->num_labels = 1;
-        txt_params->display_text = (char*)g_malloc0 (MAX_DISPLAY_LEN);
-        offset = snprintf(txt_params->display_text, MAX_DISPLAY_LEN, "Person = %d ", person_count);
-        offset = snprintf(txt_params->display_text + offset , MAX_DISPLAY_LEN, "Wheelchair = %d ", vehicle_count);
+        update_occupancy(frame_meta, now_ms, person_count, seen_wheelchair_ids);
 
-        /* Now set the offsets where the string should appear */
-        txt_params->x_offset = 10;
-        txt_params->y_offset = 12;
-
-        /* Font , font-color and font-size */
-        txt_params[display_meta->num_labels].font_params.font_name = (char*)"Serif";
-        txt_params[display_meta->num_labels].font_params.font_size = 20;
-        txt_params[display_meta->num_labels].font_params.font_color.red = 0.0;
-        txt_params[display_meta->num_labels].font_params.font_color.green = 0.0;
-        txt_params[display_meta->num_labels].font_params.font_color.blue = 0.0;
-        txt_params[display_meta->num_labels].font_params.font_color.alpha = 1.0;
+        // Every wheelchair box is styled once, from its final status.
+        for (size_t i = 0; i < wheelchair_metas.size(); i++) {
+          Wheelie *wheelie = attendance_find_wheelchair(&attendance, seen_wheelchair_ids[i]);
+          OverlayStyleId style = OVERLAY_STYLE_NEW;
+          if (wheelie && wheelie->processed_status) {
+            style = attendance_is_unattended(wheelie) ?
+                OVERLAY_STYLE_UNATTENDED : OVERLAY_STYLE_ATTENDED;
+          }
+          overlay_builder_apply_style(wheelchair_metas[i], style);
+        }
 
-        /* Text background color */
-        txt_params[display_meta->num_labels].set_bg_clr = 1;
-        txt_params[display_meta->num_labels].text_bg_clr.red = 1.0;
-        txt_params[display_meta->num_labels].text_bg_clr.green = 1.0;
-        txt_params[display_meta->num_labels].text_bg_clr.blue = 1.0;
-        txt_params[display_meta->num_labels].text_bg_clr.alpha = 1.0;
+        overlay_builder_add_label(&overlay_builder, batch_meta, frame_meta,
+            person_count, vehicle_count);
+    }
 
-        nvds_add_display_meta_to_frame(frame_meta, display_meta);
+    if (surface) {
+      gst_buffer_unmap (buf, &in_map_info);
     }
 
     frame_number++;
     return GST_PAD_PROBE_OK;
 }
 
+/* Time the batch has spent in the pipeline so far, measured from its running
+ * time to the pipeline clock. */
+static guint64
+buffer_latency (GstPad * pad, GstBuffer * buf)
+{
+  GstClock *clock = gst_element_get_clock (pipeline_element);
+  GstEvent *segment_event = NULL;
+  const GstSegment *segment = NULL;
+  guint64 now, running_time;
+
+  if (!clock)
+    return 0;
+  now = gst_clock_get_time (clock) - gst_element_get_base_time (pipeline_element);
+  gst_object_unref (clock);
+
+  segment_event = gst_pad_get_sticky_event (pad, GST_EVENT_SEGMENT, 0);
+  if (!segment_event)
+    return 0;
+  gst_event_parse_segment (segment_event, &segment);
+  running_time = gst_segment_to_running_time (segment, GST_FORMAT_TIME,
+      GST_BUFFER_PTS (buf));
+  gst_event_unref (segment_event);
+
+  if (!GST_CLOCK_TIME_IS_VALID (running_time) || now <= running_time)
+    return 0;
+  return now - running_time;
+}
+
+/* Counts the frames of every batch leaving the muxer per source. */
+static GstPadProbeReturn
+streammux_src_pad_buffer_probe (GstPad * pad, GstPadProbeInfo * info,
+    gpointer u_data)
+{
+  NvDsBatchMeta *batch_meta =
+      gst_buffer_get_nvds_batch_meta ((GstBuffer *) info->data);
+  std::vector<uint32_t> source_ids;
+
+  if (!batch_meta)
+    return GST_PAD_PROBE_OK;
+
+  for (NvDsMetaList * l_frame = batch_meta->frame_meta_list; l_frame != NULL;
+      l_frame = l_frame->next) {
+    source_ids.emplace_back (((NvDsFrameMeta *) l_frame->data)->source_id);
+  }
+  latency_policy_frames_muxed (&latency_policy, source_ids);
+  return GST_PAD_PROBE_OK;
+}
+
+/* Drops the whole batch before inference if any of its frames is already
+ * over its source's latency budget. */
+static GstPadProbeReturn
+pgie_sink_pad_buffer_probe (GstPad * pad, GstPadProbeInfo * info,
+    gpointer u_data)
+{
+  GstBuffer *buf = (GstBuffer *) info->data;
+  NvDsBatchMeta *batch_meta = gst_buffer_get_nvds_batch_meta (buf);
+  guint64 latency = 0;
+  guint queued_buffers = 0;
+  std::vector<FrameLatency> frames;
+
+  if (!batch_meta)
+    return GST_PAD_PROBE_OK;
+  latency = buffer_latency (pad, buf);
+
+  for (auto q_it = stage_queues.begin (); q_it != stage_queues.end (); ++q_it) {
+    guint level = 0;
+    g_object_get (G_OBJECT (*q_it), "current-level-buffers", &level, NULL);
+    queued_buffers += level;
+  }
+
+  for (NvDsMetaList * l_frame = batch_meta->frame_meta_list; l_frame != NULL;
+      l_frame = l_frame->next) {
+    frames.push_back ({((NvDsFrameMeta *) l_frame->data)->source_id, latency});
+  }
+
+  if (!latency_policy_admit_batch (&latency_policy, frames, queued_buffers))
+    return GST_PAD_PROBE_DROP;
+  return GST_PAD_PROBE_OK;
+}
+
+/* Records the end-to-end latency of every frame leaving the last queue. */
+static GstPadProbeReturn
+queue_sink_src_pad_buffer_probe (GstPad * pad, GstPadProbeInfo * info,
+    gpointer u_data)
+{
+  GstBuffer *buf = (GstBuffer *) info->data;
+  NvDsBatchMeta *batch_meta = gst_buffer_get_nvds_batch_meta (buf);
+  guint64 latency = 0;
+
+  if (!batch_meta)
+    return GST_PAD_PROBE_OK;
+  latency = buffer_latency (pad, buf);
+
+  for (NvDsMetaList * l_frame = batch_meta->frame_meta_list; l_frame != NULL;
+      l_frame = l_frame->next) {
+    latency_policy_frame_done (&latency_policy,
+        ((NvDsFrameMeta *) l_frame->data)->source_id, latency);
+  }
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+print_latency_stats ()
+{
+  std::map<uint32_t, SourceLatencyStats> stats =
+      latency_policy_get_stats (&latency_policy);
+
+  for (auto s_it = stats.begin (); s_it != stats.end (); ++s_it) {
+    const SourceLatencyStats &st = s_it->second;
+    g_print ("Source %u: %llu frames muxed, %llu out, %llu dropped over budget, "
+        "%llu dropped by queues, %llu late, max latency %llu ms, "
+        "queued buffers avg %.1f max %u\n", s_it->first,
+        (unsigned long long) st.frames_muxed,
+        (unsigned long long) st.frames_out,
+        (unsigned long long) st.dropped_budget,
+        (unsigned long long) latency_policy_queue_drops (&st),
+        (unsigned long long) st.late,
+        (unsigned long long) (st.latency_max_ns / GST_MSECOND),
+        st.occupancy_samples ?
+            (double) st.occupancy_sum / st.occupancy_samples : 0.0,
+        st.occupancy_max);
+  }
+}
+
 static gboolean
 bus_call (GstBus * bus, GstMessage * msg, gpointer data)
 {
@@ -544,6 +728,198 @@ done:
   return ret;
 }
 
+/* Zone config parsing. Every [zone-<id>] group describes one polygon, in
+ * muxer output coordinates, for the source given by source-id. */
+
+#define CONFIG_GROUP_ZONE_PREFIX "zone-"
+#define CONFIG_ZONE_SOURCE_ID "source-id"
+#define CONFIG_ZONE_POLYGON "polygon"
+
+static gboolean
+load_zone_config (const gchar *cfg_file_path)
+{
+  gboolean ret = FALSE;
+  GError *error = NULL;
+  gchar **groups = NULL;
+  gchar **group = NULL;
+  gint *coords = NULL;
+  GKeyFile *key_file = NULL;
+
+  /* Zones are optional, without a config file every detection is kept. */
+  if (!g_file_test (cfg_file_path, G_FILE_TEST_EXISTS)) {
+    return TRUE;
+  }
+
+  key_file = g_key_file_new ();
+  if (!g_key_file_load_from_file (key_file, cfg_file_path, G_KEY_FILE_NONE,
+          &error)) {
+    g_printerr ("Failed to load config file: %s\n", error->message);
+    g_error_free (error);
+    g_key_file_free (key_file);
+    return FALSE;
+  }
+
+  groups = g_key_file_get_groups (key_file, NULL);
+  for (group = groups; *group; group++) {
+    gsize num_coords = 0;
+    guint source_id;
+    gint zone_id;
+    std::vector<ZonePoint> polygon;
+
+    if (!g_str_has_prefix (*group, CONFIG_GROUP_ZONE_PREFIX)) {
+      g_printerr ("Unknown group [%s] in %s\n", *group, cfg_file_path);
+      continue;
+    }
+
+    zone_id = atoi (*group + strlen (CONFIG_GROUP_ZONE_PREFIX));
+
+    source_id = g_key_file_get_integer (key_file, *group,
+        CONFIG_ZONE_SOURCE_ID, &error);
+    CHECK_ERROR (error);
+
+    coords = g_key_file_get_integer_list (key_file, *group,
+        CONFIG_ZONE_POLYGON, &num_coords, &error);
+    CHECK_ERROR (error);
+
+    if (num_coords % 2) {
+      g_printerr ("Zone [%s] has an odd number of polygon coordinates\n", *group);
+      goto done;
+    }
+    for (gsize c = 0; c + 1 < num_coords; c += 2) {
+      polygon.push_back ({coords[c], coords[c + 1]});
+    }
+    g_free (coords);
+    coords = NULL;
+
+    auto mask_it = zone_masks.find (source_id);
+    if (mask_it == zone_masks.end ()) {
+      mask_it = zone_masks.emplace (source_id, ZoneMask ()).first;
+      zone_mask_init (&mask_it->second, MUXER_OUTPUT_WIDTH, MUXER_OUTPUT_HEIGHT,
+          ZONE_MASK_CELL_SIZE);
+    }
+    if (!zone_mask_add_polygon (&mask_it->second, zone_id, polygon)) {
+      g_printerr ("Zone [%s] needs an id in 1..%d and at least 3 points\n",
+          *group, ZONE_MAX_ID);
+      goto done;
+    }
+  }
+
+  ret = TRUE;
+done:
+  if (error) {
+    g_error_free (error);
+  }
+  g_free (coords);
+  g_strfreev (groups);
+  g_key_file_free (key_file);
+  if (!ret) {
+    g_printerr ("%s failed", __func__);
+  }
+  return ret;
+}
+
+/* Pipeline config parsing. [queue] sets the inter-stage queues, [latency]
+ * the default latency budget and [source-<id>] a per-source budget. */
+
+#define CONFIG_GROUP_QUEUE "queue"
+#define CONFIG_QUEUE_MAX_SIZE_BUFFERS "max-size-buffers"
+#define CONFIG_QUEUE_LEAKY "leaky"
+#define CONFIG_GROUP_LATENCY "latency"
+#define CONFIG_GROUP_SOURCE_PREFIX "source-"
+#define CONFIG_LATENCY_BUDGET_MSEC "budget-ms"
+
+static gboolean
+load_pipeline_config (const gchar *cfg_file_path, guint *queue_max_buffers,
+    gint *queue_leaky)
+{
+  gboolean ret = FALSE;
+  GError *error = NULL;
+  gchar **groups = NULL;
+  gchar **group = NULL;
+  GKeyFile *key_file = NULL;
+  std::map<guint, guint> source_budgets;
+
+  *queue_max_buffers = QUEUE_MAX_SIZE_BUFFERS;
+  *queue_leaky = QUEUE_LEAKY;
+  latency_policy_init (&latency_policy, LATENCY_BUDGET_MSEC * GST_MSECOND);
+
+  if (!g_file_test (cfg_file_path, G_FILE_TEST_EXISTS)) {
+    return TRUE;
+  }
+
+  key_file = g_key_file_new ();
+  if (!g_key_file_load_from_file (key_file, cfg_file_path, G_KEY_FILE_NONE,
+          &error)) {
+    g_printerr ("Failed to load config file: %s\n", error->message);
+    g_error_free (error);
+    g_key_file_free (key_file);
+    return FALSE;
+  }
+
+  groups = g_key_file_get_groups (key_file, NULL);
+  for (group = groups; *group; group++) {
+    if (!g_strcmp0 (*group, CONFIG_GROUP_QUEUE)) {
+      if (g_key_file_has_key (key_file, *group, CONFIG_QUEUE_MAX_SIZE_BUFFERS,
+              NULL)) {
+        *queue_max_buffers = g_key_file_get_integer (key_file, *group,
+            CONFIG_QUEUE_MAX_SIZE_BUFFERS, &error);
+        CHECK_ERROR (error);
+      }
+      if (g_key_file_has_key (key_file, *group, CONFIG_QUEUE_LEAKY, NULL)) {
+        *queue_leaky = g_key_file_get_integer (key_file, *group,
+            CONFIG_QUEUE_LEAKY, &error);
+        CHECK_ERROR (error);
+      }
+    } else if (!g_strcmp0 (*group, CONFIG_GROUP_LATENCY)) {
+      guint budget_ms = g_key_file_get_integer (key_file, *group,
+          CONFIG_LATENCY_BUDGET_MSEC, &error);
+      CHECK_ERROR (error);
+      latency_policy_init (&latency_policy, budget_ms * GST_MSECOND);
+    } else if (g_str_has_prefix (*group, CONFIG_GROUP_SOURCE_PREFIX)) {
+      guint source_id = atoi (*group + strlen (CONFIG_GROUP_SOURCE_PREFIX));
+      guint budget_ms = g_key_file_get_integer (key_file, *group,
+          CONFIG_LATENCY_BUDGET_MSEC, &error);
+      CHECK_ERROR (error);
+      source_budgets[source_id] = budget_ms;
+    } else {
+      g_printerr ("Unknown group [%s] in %s\n", *group, cfg_file_path);
+    }
+  }
+
+  /* Per-source budgets win over [latency] whatever the group order. */
+  for (auto b_it = source_budgets.begin (); b_it != source_budgets.end (); ++b_it) {
+    latency_policy_set_budget (&latency_policy, b_it->first,
+        b_it->second * GST_MSECOND);
+  }
+
+  ret = TRUE;
+done:
+  if (error) {
+    g_error_free (error);
+  }
+  g_strfreev (groups);
+  g_key_file_free (key_file);
+  if (!ret) {
+    g_printerr ("%s failed", __func__);
+  }
+  return ret;
+}
+
+static GstElement *
+create_stage_queue (const gchar *name, guint max_buffers, gint leaky)
+{
+  GstElement *queue = gst_element_factory_make ("queue", name);
+
+  if (!queue)
+    return NULL;
+
+  /* Bound the queue by buffer count only. */
+  g_object_set (G_OBJECT (queue), "max-size-buffers", max_buffers,
+      "max-size-bytes", 0, "max-size-time", (guint64) 0, "leaky", leaky, NULL);
+  stage_queues.push_back (queue);
+  return queue;
+}
+
 static GstElement *
 create_source_bin (guint index, gchar * uri)
 {
@@ -598,6 +974,10 @@ main (int argc, char *argv[])
   GstElement *pipeline = NULL, *source = NULL, *h264parser = NULL,
       *decoder = NULL, *streammux = NULL, *sink = NULL, *pgie = NULL, *sgie = NULL, *nvvidconv = NULL,
       *nvosd = NULL, *nvtracker = NULL;
+  GstElement *queue_pgie = NULL, *queue_sgie = NULL, *queue_tracker = NULL,
+      *queue_conv = NULL, *queue_sink = NULL;
+  guint queue_max_buffers;
+  gint queue_leaky;
   guint num_sources = 1;
   guint i;
   g_print ("With tracker\n");
@@ -607,6 +987,8 @@ main (int argc, char *argv[])
   GstBus *bus = NULL;
   guint bus_watch_id = 0;
   GstPad *osd_sink_pad = NULL;
+  GstPad *probe_pad = NULL;
+  guint occupancy_timer_id = 0;
 
   /* Check input arguments */
   if (argc != 2) {
@@ -622,6 +1004,7 @@ main (int argc, char *argv[])
 
   /* Create Pipeline element that will be a container of other elements */
   pipeline = gst_pipeline_new ("dstest2-pipeline");
+  pipeline_element = pipeline;
 
   /* Create nvstreammux instance to form batches from one or more sources. */
   streammux = gst_element_factory_make ("nvstreammux", "stream-muxer");
@@ -689,8 +1072,25 @@ main (int argc, char *argv[])
 #endif
   sink = gst_element_factory_make ("nveglglessink", "nvvideo-renderer");
 
+  if (!load_pipeline_config (PIPELINE_CONFIG_FILE, &queue_max_buffers,
+          &queue_leaky)) {
+    g_printerr ("Failed to load pipeline config. Exiting.\n");
+    return -1;
+  }
+
+  /* Queues decouple the stages so one slow element does not stall the
+   * others. */
+  queue_pgie = create_stage_queue ("queue-pgie", queue_max_buffers, queue_leaky);
+  queue_sgie = create_stage_queue ("queue-sgie", queue_max_buffers, queue_leaky);
+  queue_tracker = create_stage_queue ("queue-tracker", queue_max_buffers,
+      queue_leaky);
+  queue_conv = create_stage_queue ("queue-conv", queue_max_buffers, queue_leaky);
+  queue_sink = create_stage_queue ("queue-sink", queue_max_buffers, queue_leaky);
+
   if (!pgie || !sgie ||
-      !nvtracker || !nvvidconv || !nvosd || !sink) {
+      !nvtracker || !nvvidconv || !nvosd || !sink ||
+      !queue_pgie || !queue_sgie || !queue_tracker || !queue_conv ||
+      !queue_sink) {
     g_printerr ("One element could not be created. Exiting.\n");
     return -1;
   }
@@ -724,6 +1124,12 @@ main (int argc, char *argv[])
     return -1;
   }
 
+  /* Rasterise the region-of-interest zones once, at muxer resolution. */
+  if (!load_zone_config (ZONES_CONFIG_FILE)) {
+    g_printerr ("Failed to load zones. Exiting.\n");
+    return -1;
+  }
+
   /* we add a message handler */
   bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
   bus_watch_id = gst_bus_add_watch (bus, bus_call, loop);
@@ -734,12 +1140,12 @@ main (int argc, char *argv[])
   /* decoder | pgie1 | nvtracker | sgie1 | sgie2 | sgie3 | etc.. */
 #ifdef PLATFORM_TEGRA
   gst_bin_add_many (GST_BIN (pipeline),
-      pgie, sgie, nvtracker,
-      nvvidconv, nvosd, transform, sink, NULL);
+      queue_pgie, pgie, queue_sgie, sgie, queue_tracker, nvtracker,
+      queue_conv, nvvidconv, nvosd, queue_sink, transform, sink, NULL);
 #else
   gst_bin_add_many (GST_BIN (pipeline),
-      pgie, sgie, nvtracker,
-      nvvidconv, nvosd, sink, NULL);
+      queue_pgie, pgie, queue_sgie, sgie, queue_tracker, nvtracker,
+      queue_conv, nvvidconv, nvosd, queue_sink, sink, NULL);
 #endif
 
   // GstPad *sinkpad, *srcpad;
@@ -773,14 +1179,16 @@ main (int argc, char *argv[])
   // }
 
 #ifdef PLATFORM_TEGRA
-  if (!gst_element_link_many (streammux, pgie, sgie, nvtracker,
-      nvvidconv, nvosd, transform, sink, NULL)) {
+  if (!gst_element_link_many (streammux, queue_pgie, pgie, queue_sgie, sgie,
+      queue_tracker, nvtracker, queue_conv, nvvidconv, nvosd, queue_sink,
+      transform, sink, NULL)) {
     g_printerr ("Elements could not be linked. Exiting.\n");
     return -1;
   }
 #else
-  if (!gst_element_link_many (streammux, pgie, sgie, nvtracker,
-      nvvidconv, nvosd, sink, NULL)) {
+  if (!gst_element_link_many (streammux, queue_pgie, pgie, queue_sgie, sgie,
+      queue_tracker, nvtracker, queue_conv, nvvidconv, nvosd, queue_sink,
+      sink, NULL)) {
     g_printerr ("Elements could not be linked. Exiting.\n");
     return -1;
   }
@@ -797,6 +1205,48 @@ main (int argc, char *argv[])
         osd_sink_pad_buffer_probe, NULL, NULL);
   gst_object_unref (osd_sink_pad);
 
+  /* Latency budget and per-source drop accounting. Frames are counted as they
+   * leave the muxer, checked against the budget right before inference and
+   * timed again as they leave the last queue. That is after its drops but
+   * ahead of nvegltransform on Tegra, which need not carry the batch meta on
+   * to the sink. */
+  probe_pad = gst_element_get_static_pad (streammux, "src");
+  gst_pad_add_probe (probe_pad, GST_PAD_PROBE_TYPE_BUFFER,
+      streammux_src_pad_buffer_probe, NULL, NULL);
+  gst_object_unref (probe_pad);
+
+  probe_pad = gst_element_get_static_pad (pgie, "sink");
+  gst_pad_add_probe (probe_pad, GST_PAD_PROBE_TYPE_BUFFER,
+      pgie_sink_pad_buffer_probe, NULL, NULL);
+  gst_object_unref (probe_pad);
+
+  probe_pad = gst_element_get_static_pad (queue_sink, "src");
+  gst_pad_add_probe (probe_pad, GST_PAD_PROBE_TYPE_BUFFER,
+      queue_sink_src_pad_buffer_probe, NULL, NULL);
+  gst_object_unref (probe_pad);
+
+  /* Per-track decisions are published to shared memory for local consumers,
+   * the app keeps running without the feed if it can not be created. */
+  decision_feed = decision_feed_create(DECISION_FEED_NAME, DECISION_FEED_CAPACITY);
+  if (!decision_feed)
+    g_printerr ("Failed to create decision feed, continuing without it\n");
+
+  if (g_file_test (SNAPSHOT_DIR, G_FILE_TEST_IS_DIR)) {
+    snapshot_pool = snapshot_pool_create (SNAPSHOT_DIR, SNAPSHOT_POOL_SIZE,
+        SNAPSHOT_MAX_WIDTH, SNAPSHOT_MAX_HEIGHT);
+#ifndef PLATFORM_TEGRA
+    /* Snapshots are copied out on the CPU, use unified memory on dGPU. */
+    g_object_set (G_OBJECT (nvvidconv), "nvbuf-memory-type", 3, NULL);
+#endif
+  }
+
+  record_traces = g_file_test (TRACE_DIR, G_FILE_TEST_IS_DIR);
+
+  occupancy_store_init (&occupancy_store);
+  overlay_builder_init (&overlay_builder);
+  occupancy_timer_id = g_timeout_add_seconds (OCCUPANCY_SNAPSHOT_INTERVAL_SEC,
+      write_occupancy_snapshot, NULL);
+
   /* Set the pipeline to "playing" state */
   g_print ("Now playing: %s\n", argv[1]);
   gst_element_set_state (pipeline, GST_STATE_PLAYING);
@@ -808,8 +1258,33 @@ main (int argc, char *argv[])
   /* Out of the main loop, clean up nicely */
   g_print ("Returned, stopping playback\n");
   gst_element_set_state (pipeline, GST_STATE_NULL);
+  print_latency_stats ();
+  g_source_remove (occupancy_timer_id);
+  write_occupancy_snapshot (NULL);
+  for (auto t_it = trace_files.begin (); t_it != trace_files.end (); ++t_it) {
+    if (t_it->second)
+      fclose (t_it->second);
+  }
   g_print ("Deleting pipeline\n");
   gst_object_unref (GST_OBJECT (pipeline));
+  decision_feed_destroy (decision_feed);
+  if (snapshot_pool) {
+    SnapshotStats stats;
+    for (size_t i = 0; i < pending_snapshot_ids.size (); i++)
+      snapshot_pool_drop_not_visible (snapshot_pool);
+    pending_snapshot_ids.clear ();
+    /* Queued crops are still being written until the pool is destroyed. */
+    snapshot_pool_destroy (snapshot_pool, &stats);
+    snapshot_pool = NULL;
+    g_print ("Snapshots: %llu submitted, %llu written, %llu dropped (pool full), "
+        "%llu dropped (bad crop), %llu dropped (not visible), "
+        "%llu failed to write\n",
+        (unsigned long long) stats.submitted, (unsigned long long) stats.written,
+        (unsigned long long) stats.dropped_pool_full,
+        (unsigned long long) stats.dropped_bad_crop,
+        (unsigned long long) stats.dropped_not_visible,
+        (unsigned long long) stats.write_failed);
+  }
   g_source_remove (bus_watch_id);
   g_main_loop_unref (loop);
   return 0;
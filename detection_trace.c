@@ -0,0 +1,84 @@
+#include "detection_trace.h"
+
+#include <stdlib.h>
+
+FILE *
+detection_trace_create(const char *path) {
+  FILE *trace = fopen(path, "w");
+  if (trace) {
+    fprintf(trace, "%s\n", DETECTION_TRACE_HEADER);
+  }
+  return trace;
+}
+
+void
+detection_trace_write_frame(FILE *trace, const TraceFrame *frame) {
+  fprintf(trace, "F %u %llu %llu\n", frame->source_id,
+      (unsigned long long) frame->frame_num, (unsigned long long) frame->pts);
+}
+
+void
+detection_trace_write_object(FILE *trace, const TraceObject *object) {
+  fprintf(trace, "O %d %d %d %d %d %d %d %d\n", object->component_id,
+      object->class_id, object->object_id, object->x, object->y, object->w,
+      object->h, object->zone_id);
+}
+
+// Parses up to `count` integers separated by spaces. Returns how many were
+// read.
+static int
+parse_fields(const char *p, long long *fields, int count) {
+  int n = 0;
+  char *end;
+  while (n < count) {
+    long long value = strtoll(p, &end, 10);
+    if (end == p) {
+      break;
+    }
+    fields[n++] = value;
+    p = end;
+  }
+  return n;
+}
+
+TraceLineType
+detection_trace_read(FILE *trace, char **line, size_t *line_len,
+    TraceFrame *frame, TraceObject *object) {
+  long long fields[8];
+  ssize_t len;
+
+  while ((len = getline(line, line_len, trace)) >= 0) {
+    const char *p = *line;
+    if (p[0] == '#' || p[0] == '\n' || p[0] == '\0') {
+      continue;
+    }
+
+    if (p[0] == 'F') {
+      if (parse_fields(p + 1, fields, 3) != 3) {
+        return TRACE_LINE_ERROR;
+      }
+      frame->source_id = fields[0];
+      frame->frame_num = fields[1];
+      frame->pts = fields[2];
+      return TRACE_LINE_FRAME;
+    }
+
+    if (p[0] == 'O') {
+      if (parse_fields(p + 1, fields, 8) != 8) {
+        return TRACE_LINE_ERROR;
+      }
+      object->component_id = fields[0];
+      object->class_id = fields[1];
+      object->object_id = fields[2];
+      object->x = fields[3];
+      object->y = fields[4];
+      object->w = fields[5];
+      object->h = fields[6];
+      object->zone_id = fields[7];
+      return TRACE_LINE_OBJECT;
+    }
+
+    return TRACE_LINE_ERROR;
+  }
+  return TRACE_LINE_END;
+}
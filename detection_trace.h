@@ -0,0 +1,54 @@
+#ifndef DETECTION_TRACE_H
+#define DETECTION_TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* Recorded detections, one text file per source, so the attendance analytics
+ * can be re-run offline without decoding or inference.
+ *
+ *   # mobilityaids detection trace v1
+ *   F <source_id> <frame_num> <pts_ns>
+ *   O <component_id> <class_id> <object_id> <left> <top> <width> <height> <zone_id>
+ *
+ * Every F line starts a frame and is followed by that frame's O lines. */
+
+#define DETECTION_TRACE_HEADER "# mobilityaids detection trace v1"
+
+struct TraceFrame {
+  uint32_t source_id;
+  uint64_t frame_num;
+  uint64_t pts;
+};
+
+struct TraceObject {
+  int component_id;
+  int class_id;
+  int object_id;
+  int x, y, w, h;
+  int zone_id;
+};
+
+FILE *
+detection_trace_create(const char *path);
+
+void
+detection_trace_write_frame(FILE *trace, const TraceFrame *frame);
+
+void
+detection_trace_write_object(FILE *trace, const TraceObject *object);
+
+enum TraceLineType {
+  TRACE_LINE_END = 0,
+  TRACE_LINE_FRAME,
+  TRACE_LINE_OBJECT,
+  TRACE_LINE_ERROR
+};
+
+/* Reads the next frame or object line, skipping comments and blank lines.
+ * `line` is scratch space reused across calls, free it when done. */
+TraceLineType
+detection_trace_read(FILE *trace, char **line, size_t *line_len,
+    TraceFrame *frame, TraceObject *object);
+
+#endif
@@ -0,0 +1,113 @@
+/* Check of the latency policy, driven the way the pipeline probes drive it
+ * but with made up source ids, latencies and queue levels. */
+
+#include <stdio.h>
+
+#include "check.h"
+#include "latency_policy.h"
+
+#define MSEC 1000000ull
+
+static bool
+admit(LatencyPolicy *policy, std::vector<FrameLatency> frames,
+    uint32_t queued_buffers) {
+  std::vector<uint32_t> source_ids;
+  for (auto f_it = frames.begin(); f_it != frames.end(); ++f_it) {
+    source_ids.push_back((*f_it).source_id);
+  }
+  latency_policy_frames_muxed(policy, source_ids);
+  return latency_policy_admit_batch(policy, frames, queued_buffers);
+}
+
+/* A frame exactly at the budget is admitted, one nanosecond over is not. */
+static void
+check_budget_boundary() {
+  LatencyPolicy policy;
+  latency_policy_init(&policy, 40 * MSEC);
+
+  CHECK(admit(&policy, {{0, 40 * MSEC}}, 0));
+  CHECK(!admit(&policy, {{0, 40 * MSEC + 1}}, 0));
+
+  latency_policy_frame_done(&policy, 0, 40 * MSEC);
+  latency_policy_frame_done(&policy, 0, 40 * MSEC + 1);
+
+  SourceLatencyStats st = latency_policy_get_stats(&policy)[0];
+  CHECK(st.frames_in == 2);
+  CHECK(st.dropped_budget == 1);
+  CHECK(st.frames_out == 2);
+  CHECK(st.late == 1);
+  CHECK(st.latency_max_ns == 40 * MSEC + 1);
+
+  // A budget of 0 disables dropping and lateness.
+  latency_policy_init(&policy, 0);
+  CHECK(admit(&policy, {{0, 1000 * MSEC}}, 0));
+  latency_policy_frame_done(&policy, 0, 1000 * MSEC);
+  st = latency_policy_get_stats(&policy)[0];
+  CHECK(st.dropped_budget == 0);
+  CHECK(st.late == 0);
+}
+
+/* A source's own budget replaces the default, and one frame over budget
+ * drops the whole batch for every source in it. */
+static void
+check_source_budget() {
+  LatencyPolicy policy;
+  latency_policy_init(&policy, 20 * MSEC);
+  latency_policy_set_budget(&policy, 1, 100 * MSEC);
+  latency_policy_set_budget(&policy, 2, 0);
+
+  CHECK(latency_policy_budget(&policy, 0) == 20 * MSEC);
+  CHECK(latency_policy_budget(&policy, 1) == 100 * MSEC);
+  CHECK(latency_policy_budget(&policy, 2) == 0);
+
+  CHECK(!admit(&policy, {{0, 50 * MSEC}}, 0));
+  CHECK(admit(&policy, {{1, 50 * MSEC}}, 0));
+  CHECK(admit(&policy, {{2, 500 * MSEC}}, 0));
+  CHECK(!admit(&policy, {{1, 101 * MSEC}}, 0));
+
+  CHECK(!admit(&policy, {{0, 50 * MSEC}, {1, 50 * MSEC}}, 0));
+
+  std::map<uint32_t, SourceLatencyStats> stats = latency_policy_get_stats(&policy);
+  CHECK(stats[0].dropped_budget == 2);
+  CHECK(stats[1].dropped_budget == 2);
+  CHECK(stats[2].dropped_budget == 0);
+}
+
+/* Frames neither dropped over budget nor done are the queue drops, and the
+ * queue levels seen before inference are averaged per source. */
+static void
+check_queue_drops() {
+  LatencyPolicy policy;
+  latency_policy_init(&policy, 40 * MSEC);
+
+  // Ten frames muxed, two of which a queue drops before inference.
+  for (int i = 0; i < 10; i++) {
+    std::vector<uint32_t> source_ids = {0};
+    latency_policy_frames_muxed(&policy, source_ids);
+  }
+  for (int i = 0; i < 8; i++) {
+    std::vector<FrameLatency> frames = {{0, (i < 3 ? 60 : 10) * MSEC}};
+    if (latency_policy_admit_batch(&policy, frames, i)) {
+      latency_policy_frame_done(&policy, 0, 10 * MSEC);
+    }
+  }
+
+  SourceLatencyStats st = latency_policy_get_stats(&policy)[0];
+  CHECK(st.frames_muxed == 10);
+  CHECK(st.frames_in == 8);
+  CHECK(st.dropped_budget == 3);
+  CHECK(st.frames_out == 5);
+  CHECK(latency_policy_queue_drops(&st) == 2);
+  CHECK(st.occupancy_samples == 8);
+  CHECK(st.occupancy_sum == 0 + 1 + 2 + 3 + 4 + 5 + 6 + 7);
+  CHECK(st.occupancy_max == 7);
+}
+
+int
+main() {
+  check_budget_boundary();
+  check_source_budget();
+  check_queue_drops();
+
+  return check_result("latency-check");
+}
@@ -0,0 +1,98 @@
+#include "latency_policy.h"
+
+void
+latency_policy_init(LatencyPolicy *policy, uint64_t default_budget_ns) {
+  std::lock_guard<std::mutex> guard(policy->lock);
+  policy->default_budget_ns = default_budget_ns;
+  policy->budgets_ns.clear();
+  policy->stats.clear();
+}
+
+void
+latency_policy_set_budget(LatencyPolicy *policy, uint32_t source_id,
+    uint64_t budget_ns) {
+  std::lock_guard<std::mutex> guard(policy->lock);
+  policy->budgets_ns[source_id] = budget_ns;
+}
+
+static uint64_t
+budget_locked(LatencyPolicy *policy, uint32_t source_id) {
+  auto iter = policy->budgets_ns.find(source_id);
+  if (iter != policy->budgets_ns.end()) {
+    return iter->second;
+  }
+  return policy->default_budget_ns;
+}
+
+uint64_t
+latency_policy_budget(LatencyPolicy *policy, uint32_t source_id) {
+  std::lock_guard<std::mutex> guard(policy->lock);
+  return budget_locked(policy, source_id);
+}
+
+void
+latency_policy_frames_muxed(LatencyPolicy *policy,
+    const std::vector<uint32_t>& source_ids) {
+  std::lock_guard<std::mutex> guard(policy->lock);
+  for (auto s_it = source_ids.begin(); s_it != source_ids.end(); ++s_it) {
+    policy->stats[*s_it].frames_muxed++;
+  }
+}
+
+uint64_t
+latency_policy_queue_drops(const SourceLatencyStats *stats) {
+  uint64_t accounted = stats->frames_out + stats->dropped_budget;
+  return stats->frames_muxed > accounted ? stats->frames_muxed - accounted : 0;
+}
+
+bool
+latency_policy_admit_batch(LatencyPolicy *policy,
+    const std::vector<FrameLatency>& frames, uint32_t queued_buffers) {
+  std::lock_guard<std::mutex> guard(policy->lock);
+
+  bool admit = true;
+  for (auto f_it = frames.begin(); f_it != frames.end(); ++f_it) {
+    SourceLatencyStats &stats = policy->stats[(*f_it).source_id];
+    stats.frames_in++;
+    stats.occupancy_sum += queued_buffers;
+    stats.occupancy_samples++;
+    if (queued_buffers > stats.occupancy_max) {
+      stats.occupancy_max = queued_buffers;
+    }
+
+    uint64_t budget = budget_locked(policy, (*f_it).source_id);
+    if (budget && (*f_it).latency_ns > budget) {
+      admit = false;
+    }
+  }
+
+  if (!admit) {
+    for (auto f_it = frames.begin(); f_it != frames.end(); ++f_it) {
+      policy->stats[(*f_it).source_id].dropped_budget++;
+    }
+  }
+  return admit;
+}
+
+void
+latency_policy_frame_done(LatencyPolicy *policy, uint32_t source_id,
+    uint64_t latency_ns) {
+  std::lock_guard<std::mutex> guard(policy->lock);
+
+  SourceLatencyStats &stats = policy->stats[source_id];
+  stats.frames_out++;
+  if (latency_ns > stats.latency_max_ns) {
+    stats.latency_max_ns = latency_ns;
+  }
+
+  uint64_t budget = budget_locked(policy, source_id);
+  if (budget && latency_ns > budget) {
+    stats.late++;
+  }
+}
+
+std::map<uint32_t, SourceLatencyStats>
+latency_policy_get_stats(LatencyPolicy *policy) {
+  std::lock_guard<std::mutex> guard(policy->lock);
+  return policy->stats;
+}
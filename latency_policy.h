@@ -0,0 +1,79 @@
+#ifndef LATENCY_POLICY_H
+#define LATENCY_POLICY_H
+
+#include <stdint.h>
+#include <map>
+#include <mutex>
+#include <vector>
+
+/* End-to-end latency budget per source and the drop accounting that goes with
+ * it. The policy only sees source ids, latencies and queue levels, so it does
+ * not depend on which elements the pipeline is built from.
+ *
+ * A batch is admitted to inference only if every frame in it is still within
+ * its source's budget. Frames that get through but reach the end of the
+ * pipeline over budget are counted as late. A budget of 0 disables both. */
+
+struct SourceLatencyStats {
+  uint64_t frames_muxed;
+  uint64_t frames_in;
+  uint64_t frames_out;
+  uint64_t dropped_budget;
+  uint64_t late;
+  uint64_t occupancy_sum;
+  uint64_t occupancy_samples;
+  uint32_t occupancy_max;
+  uint64_t latency_max_ns;
+};
+
+struct LatencyPolicy {
+  uint64_t default_budget_ns;
+  std::map<uint32_t, uint64_t> budgets_ns;
+  std::map<uint32_t, SourceLatencyStats> stats;
+  std::mutex lock;
+};
+
+struct FrameLatency {
+  uint32_t source_id;
+  uint64_t latency_ns;
+};
+
+void
+latency_policy_init(LatencyPolicy *policy, uint64_t default_budget_ns);
+
+void
+latency_policy_set_budget(LatencyPolicy *policy, uint32_t source_id,
+    uint64_t budget_ns);
+
+uint64_t
+latency_policy_budget(LatencyPolicy *policy, uint32_t source_id);
+
+/* Called as frames leave the muxer, before any queue had a chance to drop
+ * them. */
+void
+latency_policy_frames_muxed(LatencyPolicy *policy,
+    const std::vector<uint32_t>& source_ids);
+
+/* Frames of a source that were muxed but neither dropped for being over
+ * budget nor reached the end of the pipeline. Once the pipeline has drained
+ * these are the frames the leaky queues dropped. */
+uint64_t
+latency_policy_queue_drops(const SourceLatencyStats *stats);
+
+/* Called before inference with every frame of a batch. Returns false if the
+ * whole batch should be dropped, in which case each frame is counted as a
+ * budget drop for its source. `queued_buffers` is the number of buffers
+ * currently held in the inter-stage queues. */
+bool
+latency_policy_admit_batch(LatencyPolicy *policy,
+    const std::vector<FrameLatency>& frames, uint32_t queued_buffers);
+
+/* Called once a frame reaches the end of the pipeline. */
+void
+latency_policy_frame_done(LatencyPolicy *policy, uint32_t source_id,
+    uint64_t latency_ns);
+
+std::map<uint32_t, SourceLatencyStats>
+latency_policy_get_stats(LatencyPolicy *policy);
+
+#endif
@@ -0,0 +1,180 @@
+#include "occupancy_store.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static const uint32_t ring_bucket_secs[OCCUPANCY_LEVELS] = { 1, 60, 3600 };
+static const uint32_t ring_sizes[OCCUPANCY_LEVELS] = {
+  OCCUPANCY_SECOND_BUCKETS, OCCUPANCY_MINUTE_BUCKETS, OCCUPANCY_HOUR_BUCKETS
+};
+
+void
+occupancy_store_init(OccupancyStore *store) {
+  size_t buckets_per_series = 0;
+  for (int level = 0; level < OCCUPANCY_LEVELS; level++) {
+    buckets_per_series += ring_sizes[level];
+  }
+  store->storage.assign(buckets_per_series * OCCUPANCY_MAX_SOURCES, OccupancyBucket());
+
+  OccupancyBucket *next = store->storage.data();
+  for (int i = 0; i < OCCUPANCY_MAX_SOURCES; i++) {
+    OccupancySeries *series = &store->series[i];
+    series->used = false;
+    series->source_id = 0;
+    for (int level = 0; level < OCCUPANCY_LEVELS; level++) {
+      OccupancyRing *ring = &series->rings[level];
+      ring->bucket_secs = ring_bucket_secs[level];
+      ring->size = ring_sizes[level];
+      ring->head = 0;
+      ring->head_start = -1;
+      ring->buckets = next;
+      next += ring->size;
+    }
+  }
+
+  // Header, then per series its id and per ring 4 fields and the buckets.
+  size_t snapshot_size = 3 * sizeof(uint32_t) + OCCUPANCY_MAX_SOURCES *
+      (sizeof(uint32_t) + OCCUPANCY_LEVELS * (3 * sizeof(uint32_t) + sizeof(int64_t)) +
+       buckets_per_series * sizeof(OccupancyBucket));
+  store->snapshot.reserve(snapshot_size);
+}
+
+static void
+merge_bucket(OccupancyBucket *into, const OccupancyBucket *from) {
+  into->samples += from->samples;
+  for (int m = 0; m < OCCUPANCY_NUM_METRICS; m++) {
+    into->sum[m] += from->sum[m];
+    if (from->max[m] > into->max[m]) {
+      into->max[m] = from->max[m];
+    }
+  }
+}
+
+/* Makes the bucket containing `now_s` the current one of `level`. The bucket
+ * being closed is merged into the next level first. Time going backwards is
+ * folded into the current bucket. */
+static OccupancyBucket *
+advance_ring(OccupancySeries *series, int level, int64_t now_s) {
+  OccupancyRing *ring = &series->rings[level];
+  int64_t start = now_s - now_s % ring->bucket_secs;
+
+  if (ring->head_start < 0) {
+    ring->head_start = start;
+    return &ring->buckets[ring->head];
+  }
+  if (start <= ring->head_start) {
+    return &ring->buckets[ring->head];
+  }
+
+  if (level + 1 < OCCUPANCY_LEVELS && ring->buckets[ring->head].samples) {
+    OccupancyBucket *coarser = advance_ring(series, level + 1, ring->head_start);
+    merge_bucket(coarser, &ring->buckets[ring->head]);
+  }
+
+  // Buckets skipped over while no samples arrived are cleared too, never more
+  // than the whole ring.
+  int64_t steps = (start - ring->head_start) / ring->bucket_secs;
+  if (steps > ring->size) {
+    steps = ring->size;
+  }
+  for (int64_t i = 0; i < steps; i++) {
+    ring->head = (ring->head + 1) % ring->size;
+    memset(&ring->buckets[ring->head], 0, sizeof(OccupancyBucket));
+  }
+  ring->head_start = start;
+  return &ring->buckets[ring->head];
+}
+
+static OccupancySeries *
+find_series(OccupancyStore *store, uint32_t source_id) {
+  for (int i = 0; i < OCCUPANCY_MAX_SOURCES; i++) {
+    OccupancySeries *series = &store->series[i];
+    if (!series->used) {
+      series->used = true;
+      series->source_id = source_id;
+      return series;
+    }
+    if (series->source_id == source_id) {
+      return series;
+    }
+  }
+  return NULL;
+}
+
+void
+occupancy_store_update(OccupancyStore *store, uint32_t source_id,
+    int64_t now_s, const uint32_t values[OCCUPANCY_NUM_METRICS]) {
+  std::lock_guard<std::mutex> guard(store->lock);
+
+  OccupancySeries *series = find_series(store, source_id);
+  if (!series) {
+    return;
+  }
+
+  OccupancyBucket *bucket = advance_ring(series, 0, now_s);
+  bucket->samples++;
+  for (int m = 0; m < OCCUPANCY_NUM_METRICS; m++) {
+    bucket->sum[m] += values[m];
+    uint16_t value = values[m] > UINT16_MAX ? UINT16_MAX : values[m];
+    if (value > bucket->max[m]) {
+      bucket->max[m] = value;
+    }
+  }
+}
+
+static void
+append(std::vector<uint8_t>& out, const void *data, size_t len) {
+  const uint8_t *bytes = (const uint8_t *) data;
+  out.insert(out.end(), bytes, bytes + len);
+}
+
+bool
+occupancy_store_write_snapshot(OccupancyStore *store, const char *path) {
+  std::vector<uint8_t>& out = store->snapshot;
+
+  // Serialise under the lock into the preallocated buffer, the file is
+  // written after it is released.
+  {
+    std::lock_guard<std::mutex> guard(store->lock);
+    uint32_t header[3] = { OCCUPANCY_SNAPSHOT_MAGIC, OCCUPANCY_SNAPSHOT_VERSION, 0 };
+    for (int i = 0; i < OCCUPANCY_MAX_SOURCES; i++) {
+      if (store->series[i].used) {
+        header[2]++;
+      }
+    }
+
+    out.clear();
+    append(out, header, sizeof(header));
+    for (int i = 0; i < OCCUPANCY_MAX_SOURCES; i++) {
+      const OccupancySeries *series = &store->series[i];
+      if (!series->used) {
+        continue;
+      }
+      append(out, &series->source_id, sizeof(series->source_id));
+      for (int level = 0; level < OCCUPANCY_LEVELS; level++) {
+        const OccupancyRing *ring = &series->rings[level];
+        append(out, &ring->bucket_secs, sizeof(ring->bucket_secs));
+        append(out, &ring->size, sizeof(ring->size));
+        append(out, &ring->head, sizeof(ring->head));
+        append(out, &ring->head_start, sizeof(ring->head_start));
+        append(out, ring->buckets, ring->size * sizeof(OccupancyBucket));
+      }
+    }
+  }
+
+  char tmp_path[512];
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+  FILE *file = fopen(tmp_path, "wb");
+  if (!file) {
+    return false;
+  }
+  bool ok = fwrite(out.data(), 1, out.size(), file) == out.size();
+  if (fclose(file) != 0) {
+    ok = false;
+  }
+  if (!ok || rename(tmp_path, path) != 0) {
+    remove(tmp_path);
+    return false;
+  }
+  return true;
+}
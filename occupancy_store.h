@@ -0,0 +1,81 @@
+#ifndef OCCUPANCY_STORE_H
+#define OCCUPANCY_STORE_H
+
+#include <stdint.h>
+#include <mutex>
+#include <vector>
+
+/* Rolling per-source occupancy history in a fixed amount of memory.
+ *
+ * Each source keeps three rings of buckets: one second, one minute and one
+ * hour wide. Samples only go into the current one second bucket. When a
+ * bucket of one ring closes it is merged into the current bucket of the next
+ * coarser ring, so an update is O(1) and the oldest buckets of every ring are
+ * simply overwritten. All the memory for OCCUPANCY_MAX_SOURCES sources is
+ * allocated up front, so usage stays flat however long the app runs. */
+
+#define OCCUPANCY_MAX_SOURCES 16
+
+#define OCCUPANCY_LEVELS 3
+#define OCCUPANCY_SECOND_BUCKETS 600   /* 10 minutes */
+#define OCCUPANCY_MINUTE_BUCKETS 1440  /* 1 day */
+#define OCCUPANCY_HOUR_BUCKETS 720     /* 30 days */
+
+#define OCCUPANCY_SNAPSHOT_MAGIC 0x534f414du /* "MAOS" */
+#define OCCUPANCY_SNAPSHOT_VERSION 1
+
+enum OccupancyMetric {
+  OCCUPANCY_PEOPLE = 0,
+  OCCUPANCY_WHEELCHAIRS,
+  OCCUPANCY_ATTENDED,
+  OCCUPANCY_UNATTENDED,
+  OCCUPANCY_NUM_METRICS
+};
+
+/* Sum and peak of every metric over the samples that fell in the bucket, the
+ * mean is sum / samples. */
+struct OccupancyBucket {
+  uint32_t samples;
+  uint32_t sum[OCCUPANCY_NUM_METRICS];
+  uint16_t max[OCCUPANCY_NUM_METRICS];
+};
+
+struct OccupancyRing {
+  uint32_t bucket_secs;
+  uint32_t size;
+  // Index of the current bucket and the time, in seconds, it starts at.
+  uint32_t head;
+  int64_t head_start;
+  OccupancyBucket *buckets;
+};
+
+struct OccupancySeries {
+  bool used;
+  uint32_t source_id;
+  OccupancyRing rings[OCCUPANCY_LEVELS];
+};
+
+struct OccupancyStore {
+  OccupancySeries series[OCCUPANCY_MAX_SOURCES];
+  std::vector<OccupancyBucket> storage;
+  std::vector<uint8_t> snapshot;
+  std::mutex lock;
+};
+
+void
+occupancy_store_init(OccupancyStore *store);
+
+/* Adds one sample of every metric for a source at time `now_s`. Sources past
+ * the first OCCUPANCY_MAX_SOURCES are ignored. */
+void
+occupancy_store_update(OccupancyStore *store, uint32_t source_id,
+    int64_t now_s, const uint32_t values[OCCUPANCY_NUM_METRICS]);
+
+/* Writes every used series to `path`, replacing it atomically. The file is
+ * a header (magic, version, number of series) followed, per series, by its
+ * source id and, per ring, bucket_secs, size, head, head_start and the raw
+ * buckets, all in host byte order. */
+bool
+occupancy_store_write_snapshot(OccupancyStore *store, const char *path);
+
+#endif
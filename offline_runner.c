@@ -0,0 +1,349 @@
+/* Offline re-analysis of recorded detection traces.
+ *
+ * Takes a manifest listing one trace file per line and shards the files over
+ * a pool of worker threads. Every file gets its own AttendanceState and runs
+ * on its trace timestamps, as fast as it can be parsed. Results are printed
+ * in manifest order once all the workers are done, so the output does not
+ * depend on the number of workers or on scheduling.
+ *
+ * Workers share nothing but the index of the next file. A file's counters
+ * and events are kept on the worker's stack while it runs and stored into
+ * its FileResult once at the end, since neighbouring results share cache
+ * lines. With -s the manifest is run at 1, 2, 4, ... up to -j workers and
+ * the throughput of each run is printed instead of the results. */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "attendance.h"
+#include "detection_trace.h"
+
+struct FileResult {
+  std::string path;
+  std::string error;
+  uint64_t frames;
+  uint64_t objects;
+  uint64_t wheelchair_tracks;
+  // One record per change of a track's attended status.
+  std::vector<DecisionRecord> events;
+};
+
+static const char *
+status_name(int status) {
+  switch (status) {
+    case DECISION_STATUS_ATTENDED:
+      return "Attended";
+    case DECISION_STATUS_UNATTENDED:
+      return "Unattended";
+    default:
+      return "Pending";
+  }
+}
+
+static void
+end_frame(AttendanceState *state, const TraceFrame *frame,
+    const std::vector<int>& seen_ids, std::map<int, int>& last_status,
+    FileResult *result) {
+  std::vector<int> unattended_ids;
+  attendance_process_frame(state, frame->pts / 1000000, unattended_ids);
+  result->frames++;
+
+  DecisionRecord record;
+  for (auto id_it = seen_ids.begin(); id_it != seen_ids.end(); ++id_it) {
+    Wheelie *wheelie = attendance_find_wheelchair(state, *id_it);
+    if (!wheelie) {
+      continue;
+    }
+
+    memset(&record, 0, sizeof(record));
+    record.pts = frame->pts;
+    record.frame_num = frame->frame_num;
+    record.source_id = frame->source_id;
+    attendance_fill_decision(wheelie, &record);
+
+    auto status_it = last_status.find(*id_it);
+    if (status_it == last_status.end()) {
+      last_status[*id_it] = record.status;
+      result->wheelchair_tracks++;
+    }
+    else if (status_it->second != record.status) {
+      status_it->second = record.status;
+      result->events.push_back(record);
+    }
+  }
+}
+
+static void
+process_file(FileResult *shared_result) {
+  FILE *trace = fopen(shared_result->path.c_str(), "r");
+  if (!trace) {
+    shared_result->error = strerror(errno);
+    return;
+  }
+
+  FileResult local;
+  FileResult *result = &local;
+  local.frames = 0;
+  local.objects = 0;
+  local.wheelchair_tracks = 0;
+
+  AttendanceState state;
+  std::map<int, int> last_status;
+  std::vector<int> seen_ids;
+  TraceFrame frame, next_frame;
+  TraceObject object;
+  bool in_frame = false;
+  char *line = NULL;
+  size_t line_len = 0;
+  TraceLineType type;
+
+  while ((type = detection_trace_read(trace, &line, &line_len, &next_frame, &object)) != TRACE_LINE_END) {
+    if (type == TRACE_LINE_ERROR) {
+      result->error = "malformed trace line";
+      break;
+    }
+
+    if (type == TRACE_LINE_FRAME) {
+      if (in_frame) {
+        end_frame(&state, &frame, seen_ids, last_status, result);
+      }
+      frame = next_frame;
+      seen_ids.clear();
+      in_frame = true;
+      continue;
+    }
+
+    if (!in_frame) {
+      result->error = "object before the first frame";
+      break;
+    }
+
+    result->objects++;
+    if (object.component_id == SGIE_COMPONENT_ID && object.class_id == SGIE_CLASS_ID_WHEELCHAIR) {
+      seen_ids.emplace_back(object.object_id);
+      attendance_add_wheelchair(&state, object.object_id, object.x, object.y,
+          object.w, object.h, object.zone_id, frame.pts / 1000000);
+    }
+    if (object.component_id == PGIE_COMPONENT_ID && object.class_id == PGIE_CLASS_ID_PERSON) {
+      attendance_add_person(&state, object.object_id, object.x, object.y,
+          object.w, object.h);
+    }
+  }
+
+  if (in_frame && result->error.empty()) {
+    end_frame(&state, &frame, seen_ids, last_status, result);
+  }
+
+  free(line);
+  fclose(trace);
+
+  shared_result->error.swap(local.error);
+  shared_result->frames = local.frames;
+  shared_result->objects = local.objects;
+  shared_result->wheelchair_tracks = local.wheelchair_tracks;
+  shared_result->events.swap(local.events);
+}
+
+static bool
+read_manifest(const char *path, std::vector<FileResult>& results) {
+  FILE *manifest = fopen(path, "r");
+  if (!manifest) {
+    fprintf(stderr, "Failed to open manifest %s: %s\n", path, strerror(errno));
+    return false;
+  }
+
+  char *line = NULL;
+  size_t line_len = 0;
+  ssize_t len;
+  while ((len = getline(&line, &line_len, manifest)) >= 0) {
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r' || line[len - 1] == ' ')) {
+      line[--len] = '\0';
+    }
+    if (len == 0 || line[0] == '#') {
+      continue;
+    }
+
+    FileResult result;
+    result.path = line;
+    result.frames = 0;
+    result.objects = 0;
+    result.wheelchair_tracks = 0;
+    results.push_back(result);
+  }
+
+  free(line);
+  fclose(manifest);
+  return true;
+}
+
+/* Runs every file of the manifest on num_workers threads, returns the wall
+ * time in seconds. */
+static double
+run_files(std::vector<FileResult>& results, unsigned int num_workers) {
+  auto start = std::chrono::steady_clock::now();
+
+  // Workers pull the next unprocessed file until the manifest is exhausted,
+  // so long and short files balance out across the pool.
+  std::atomic<size_t> next_file(0);
+  std::vector<std::thread> workers;
+  for (unsigned int i = 0; i < num_workers; i++) {
+    workers.emplace_back([&results, &next_file] {
+      size_t index;
+      while ((index = next_file.fetch_add(1)) < results.size()) {
+        process_file(&results[index]);
+      }
+    });
+  }
+  for (auto w_it = workers.begin(); w_it != workers.end(); ++w_it) {
+    (*w_it).join();
+  }
+
+  return std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+}
+
+static void
+sum_files(const std::vector<FileResult>& results, uint64_t *frames,
+    uint64_t *objects) {
+  *frames = 0;
+  *objects = 0;
+  for (auto r_it = results.begin(); r_it != results.end(); ++r_it) {
+    *frames += (*r_it).frames;
+    *objects += (*r_it).objects;
+  }
+}
+
+/* Runs the manifest at 1, 2, 4, ... up to max_workers workers and prints the
+ * throughput of each run. A first untimed run warms the page cache, so the
+ * single worker run is not the only one reading from disk. */
+static int
+sweep_workers(const std::vector<FileResult>& manifest, unsigned int max_workers) {
+  std::vector<FileResult> results = manifest;
+  run_files(results, max_workers);
+  uint64_t expected_frames, expected_objects;
+  sum_files(results, &expected_frames, &expected_objects);
+
+  printf("%zu files, %llu frames, %llu objects, %u hardware threads\n",
+      manifest.size(), (unsigned long long) expected_frames,
+      (unsigned long long) expected_objects, std::thread::hardware_concurrency());
+  printf("%8s %10s %14s %14s %9s\n", "workers", "seconds", "frames/sec",
+      "objects/sec", "speedup");
+
+  double single_seconds = 0;
+  for (unsigned int n = 1; ; n = n * 2 < max_workers ? n * 2 : max_workers) {
+    results = manifest;
+    double seconds = run_files(results, n);
+    uint64_t frames, objects;
+    sum_files(results, &frames, &objects);
+    if (frames != expected_frames || objects != expected_objects) {
+      fprintf(stderr, "Run with %u workers counted %llu frames, %llu objects\n",
+          n, (unsigned long long) frames, (unsigned long long) objects);
+      return 1;
+    }
+    if (n == 1) {
+      single_seconds = seconds;
+    }
+
+    printf("%8u %10.3f %14.0f %14.0f %8.2fx\n", n, seconds, frames / seconds,
+        objects / seconds, single_seconds / seconds);
+    if (n == max_workers) {
+      break;
+    }
+  }
+
+  return 0;
+}
+
+static void
+usage(const char *app) {
+  fprintf(stderr, "Usage: %s [-j <workers>] [-s] <manifest>\n", app);
+}
+
+int
+main(int argc, char *argv[]) {
+  unsigned int num_workers = std::thread::hardware_concurrency();
+  bool sweep = false;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "j:s")) != -1) {
+    switch (opt) {
+      case 'j':
+        num_workers = atoi(optarg);
+        break;
+      case 's':
+        sweep = true;
+        break;
+      default:
+        usage(argv[0]);
+        return -1;
+    }
+  }
+  if (optind != argc - 1) {
+    usage(argv[0]);
+    return -1;
+  }
+  if (num_workers == 0) {
+    num_workers = 1;
+  }
+
+  std::vector<FileResult> results;
+  if (!read_manifest(argv[optind], results)) {
+    return -1;
+  }
+  if (num_workers > results.size()) {
+    num_workers = results.size() ? results.size() : 1;
+  }
+
+  if (sweep) {
+    return sweep_workers(results, num_workers);
+  }
+
+  double seconds = run_files(results, num_workers);
+
+  uint64_t total_frames = 0, total_objects = 0, total_events = 0;
+  int failed = 0;
+  for (auto r_it = results.begin(); r_it != results.end(); ++r_it) {
+    const FileResult &result = *r_it;
+    total_frames += result.frames;
+    total_objects += result.objects;
+    total_events += result.events.size();
+
+    if (!result.error.empty()) {
+      failed++;
+      printf("%s: error: %s\n", result.path.c_str(), result.error.c_str());
+      continue;
+    }
+
+    printf("%s: %llu frames, %llu objects, %llu wheelchair tracks, %zu events\n",
+        result.path.c_str(), (unsigned long long) result.frames,
+        (unsigned long long) result.objects,
+        (unsigned long long) result.wheelchair_tracks, result.events.size());
+    for (auto e_it = result.events.begin(); e_it != result.events.end(); ++e_it) {
+      printf("  pts=%llu frame=%llu source=%u tracker=%d zone=%u status=%s ratio=%.2f\n",
+          (unsigned long long) (*e_it).pts, (unsigned long long) (*e_it).frame_num,
+          (*e_it).source_id, (*e_it).tracker_id, (*e_it).zone_id,
+          status_name((*e_it).status), (*e_it).ratio);
+    }
+  }
+
+  printf("%zu files (%d failed), %llu frames, %llu objects, %llu events "
+      "with %u workers in %.3f s\n", results.size(), failed,
+      (unsigned long long) total_frames, (unsigned long long) total_objects,
+      (unsigned long long) total_events, num_workers, seconds);
+  if (seconds > 0) {
+    printf("%.0f frames/sec, %.0f objects/sec\n", total_frames / seconds,
+        total_objects / seconds);
+  }
+
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,236 @@
+/* Benchmark of the per-frame overlay work.
+ *
+ * Styles the wheelchair boxes of a synthetic frame and adds its count label,
+ * once the way the probe used to (every box written green, then every object
+ * matched against every track by status string to turn unattended ones red,
+ * and the label formatted with snprintf) and once through the overlay
+ * builder, for a growing number of objects. A quarter of the objects are
+ * wheelchairs, half of those unattended. Display metas come from a real
+ * batch meta pool and are released after every frame, which frees their
+ * text like the pipeline does. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <vector>
+
+#include <glib.h>
+
+#include "attendance.h"
+#include "overlay_builder.h"
+
+#define MAX_DISPLAY_LEN 64
+
+struct BenchFrame {
+  NvDsBatchMeta *batch_meta;
+  NvDsFrameMeta *frame_meta;
+  std::vector<NvDsObjectMeta> objects;
+  std::vector<NvDsObjectMeta *> wheelchair_metas;
+  std::vector<int> wheelchair_ids;
+  guint person_count;
+  guint wheelchair_count;
+};
+
+static void
+make_frame(BenchFrame *frame, AttendanceState *state, int num_objects) {
+  frame->objects.assign(num_objects, NvDsObjectMeta());
+  frame->wheelchair_metas.clear();
+  frame->wheelchair_ids.clear();
+  frame->person_count = 0;
+  frame->wheelchair_count = 0;
+
+  for (int i = 0; i < num_objects; i++) {
+    NvDsObjectMeta *obj_meta = &frame->objects[i];
+    obj_meta->object_id = i;
+    obj_meta->rect_params.left = (i * 37) % 1800;
+    obj_meta->rect_params.top = (i * 53) % 1000;
+    obj_meta->rect_params.width = 80;
+    obj_meta->rect_params.height = 80;
+
+    if (i % 4 == 0) {
+      obj_meta->unique_component_id = SGIE_COMPONENT_ID;
+      obj_meta->class_id = SGIE_CLASS_ID_WHEELCHAIR;
+      attendance_add_wheelchair(state, i, obj_meta->rect_params.left,
+          obj_meta->rect_params.top, 80, 80, 0, 0);
+      Wheelie *wheelie = attendance_find_wheelchair(state, i);
+      wheelie->processed_status = true;
+      wheelie->status = (i / 4) % 2 ? "Unattended" : "Attended";
+      frame->wheelchair_metas.push_back(obj_meta);
+      frame->wheelchair_ids.push_back(i);
+      frame->wheelchair_count++;
+    }
+    else {
+      obj_meta->unique_component_id = PGIE_COMPONENT_ID;
+      obj_meta->class_id = PGIE_CLASS_ID_PERSON;
+      frame->person_count++;
+    }
+  }
+}
+
+static void
+release_display_metas(NvDsFrameMeta *frame_meta) {
+  while (frame_meta->display_meta_list) {
+    nvds_remove_display_meta_from_frame(frame_meta,
+        (NvDsDisplayMeta *) frame_meta->display_meta_list->data);
+  }
+}
+
+/* The probe's overlay code before the overlay builder. */
+static void
+old_overlay(BenchFrame *frame, AttendanceState *state) {
+  for (auto o_it = frame->objects.begin(); o_it != frame->objects.end(); ++o_it) {
+    NvDsObjectMeta *obj_meta = &(*o_it);
+    if (obj_meta->unique_component_id == SGIE_COMPONENT_ID &&
+        obj_meta->class_id == SGIE_CLASS_ID_WHEELCHAIR) {
+      #ifndef PLATFORM_TEGRA
+        obj_meta->rect_params.has_bg_color = 1;
+        obj_meta->rect_params.bg_color.red = 0;
+        obj_meta->rect_params.bg_color.green = 1;
+        obj_meta->rect_params.bg_color.blue = 0;
+        obj_meta->rect_params.bg_color.alpha = 0.2;
+      #endif
+      obj_meta->rect_params.border_width = 8;
+      obj_meta->rect_params.border_color.red = 0;
+      obj_meta->rect_params.border_color.green = 1;
+      obj_meta->rect_params.border_color.blue = 0;
+      obj_meta->rect_params.border_color.alpha = 0.2;
+      obj_meta->text_params.font_params.font_size = 14;
+    }
+  }
+
+  for (auto o_it = frame->objects.begin(); o_it != frame->objects.end(); ++o_it) {
+    NvDsObjectMeta *obj_meta = &(*o_it);
+    int cur_obj_id = obj_meta->object_id;
+    for (auto iter = state->wheelchair_tracker.begin(); iter != state->wheelchair_tracker.end(); ++iter) {
+      if ((*iter).tracker_id == cur_obj_id && (*iter).processed_status &&
+          (*iter).status.compare("Unattended") == 0) {
+        #ifndef PLATFORM_TEGRA
+          obj_meta->rect_params.has_bg_color = 1;
+          obj_meta->rect_params.bg_color.red = 1;
+          obj_meta->rect_params.bg_color.green = 0;
+          obj_meta->rect_params.bg_color.blue = 0;
+          obj_meta->rect_params.bg_color.alpha = 0.2;
+        #endif
+        obj_meta->rect_params.border_width = 8;
+        obj_meta->rect_params.border_color.red = 1;
+        obj_meta->rect_params.border_color.green = 0;
+        obj_meta->rect_params.border_color.blue = 0;
+        obj_meta->rect_params.border_color.alpha = 0.2;
+        obj_meta->text_params.font_params.font_size = 14;
+      }
+    }
+  }
+
+  NvDsDisplayMeta *display_meta = nvds_acquire_display_meta_from_pool(frame->batch_meta);
+  NvOSD_TextParams *txt_params = &display_meta->text_params[0];
+  display_meta->num_labels = 1;
+  txt_params->display_text = (char*)g_malloc0(MAX_DISPLAY_LEN);
+  int offset = snprintf(txt_params->display_text, MAX_DISPLAY_LEN, "Person = %d ",
+      frame->person_count);
+  snprintf(txt_params->display_text + offset, MAX_DISPLAY_LEN - offset,
+      "Wheelchair = %d ", frame->wheelchair_count);
+
+  txt_params->x_offset = 10;
+  txt_params->y_offset = 12;
+  txt_params->font_params.font_name = (char*)"Serif";
+  txt_params->font_params.font_size = 20;
+  txt_params->font_params.font_color.red = 0.0;
+  txt_params->font_params.font_color.green = 0.0;
+  txt_params->font_params.font_color.blue = 0.0;
+  txt_params->font_params.font_color.alpha = 1.0;
+  txt_params->set_bg_clr = 1;
+  txt_params->text_bg_clr.red = 1.0;
+  txt_params->text_bg_clr.green = 1.0;
+  txt_params->text_bg_clr.blue = 1.0;
+  txt_params->text_bg_clr.alpha = 1.0;
+
+  nvds_add_display_meta_to_frame(frame->frame_meta, display_meta);
+}
+
+/* The probe's overlay code now. */
+static void
+new_overlay(BenchFrame *frame, AttendanceState *state, OverlayBuilder *builder) {
+  for (size_t i = 0; i < frame->wheelchair_metas.size(); i++) {
+    Wheelie *wheelie = attendance_find_wheelchair(state, frame->wheelchair_ids[i]);
+    OverlayStyleId style = OVERLAY_STYLE_NEW;
+    if (wheelie && wheelie->processed_status) {
+      style = attendance_is_unattended(wheelie) ?
+          OVERLAY_STYLE_UNATTENDED : OVERLAY_STYLE_ATTENDED;
+    }
+    overlay_builder_apply_style(frame->wheelchair_metas[i], style);
+  }
+
+  overlay_builder_add_label(builder, frame->batch_meta, frame->frame_meta,
+      frame->person_count, frame->wheelchair_count);
+}
+
+static double
+elapsed_ns(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::nano>(
+      std::chrono::steady_clock::now() - start).count();
+}
+
+static void
+usage(const char *app) {
+  fprintf(stderr, "Usage: %s [-f <frames>]\n", app);
+}
+
+int
+main(int argc, char *argv[]) {
+  int num_frames = 5000;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "f:")) != -1) {
+    switch (opt) {
+      case 'f':
+        num_frames = atoi(optarg);
+        break;
+      default:
+        usage(argv[0]);
+        return -1;
+    }
+  }
+  if (num_frames <= 0) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  BenchFrame frame;
+  frame.batch_meta = nvds_create_batch_meta(1);
+  frame.frame_meta = nvds_acquire_frame_meta_from_pool(frame.batch_meta);
+  nvds_add_frame_meta_to_batch(frame.batch_meta, frame.frame_meta);
+
+  static const int object_counts[] = { 16, 64, 256, 1024 };
+
+  printf("%d frames per run, a quarter of the objects are wheelchairs\n", num_frames);
+  printf("%8s %14s %14s %9s\n", "objects", "old us/frame", "new us/frame", "speedup");
+
+  for (size_t c = 0; c < sizeof(object_counts) / sizeof(object_counts[0]); c++) {
+    AttendanceState state;
+    OverlayBuilder builder;
+    overlay_builder_init(&builder);
+    make_frame(&frame, &state, object_counts[c]);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int f = 0; f < num_frames; f++) {
+      old_overlay(&frame, &state);
+      release_display_metas(frame.frame_meta);
+    }
+    double old_us = elapsed_ns(start) / num_frames / 1000;
+
+    start = std::chrono::steady_clock::now();
+    for (int f = 0; f < num_frames; f++) {
+      new_overlay(&frame, &state, &builder);
+      release_display_metas(frame.frame_meta);
+    }
+    double new_us = elapsed_ns(start) / num_frames / 1000;
+
+    printf("%8d %14.3f %14.3f %8.1fx\n", object_counts[c], old_us, new_us,
+        old_us / new_us);
+  }
+
+  nvds_destroy_batch_meta(frame.batch_meta);
+  return 0;
+}
@@ -0,0 +1,108 @@
+#include "overlay_builder.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define MAX_DISPLAY_LEN 64
+
+struct OverlayStyle {
+  unsigned int border_width;
+  NvOSD_ColorParams border_color;
+  unsigned int has_bg_color;
+  NvOSD_ColorParams bg_color;
+  unsigned int font_size;
+};
+
+// New and attended wheelchairs are green, unattended ones red.
+static const OverlayStyle overlay_styles[OVERLAY_NUM_STYLES] = {
+  { 8, { 0, 1, 0, 0.2 }, 1, { 0, 1, 0, 0.2 }, 14 },
+  { 8, { 0, 1, 0, 0.2 }, 1, { 0, 1, 0, 0.2 }, 14 },
+  { 8, { 1, 0, 0, 0.2 }, 1, { 1, 0, 0, 0.2 }, 14 },
+};
+
+void
+overlay_builder_init(OverlayBuilder *builder) {
+  builder->labels.clear();
+  builder->sources.clear();
+
+  NvOSD_TextParams *txt = &builder->label_template;
+  memset(txt, 0, sizeof(*txt));
+
+  /* Now set the offsets where the string should appear */
+  txt->x_offset = 10;
+  txt->y_offset = 12;
+
+  /* Font , font-color and font-size */
+  txt->font_params.font_name = (char*)"Serif";
+  txt->font_params.font_size = 20;
+  txt->font_params.font_color.red = 0.0;
+  txt->font_params.font_color.green = 0.0;
+  txt->font_params.font_color.blue = 0.0;
+  txt->font_params.font_color.alpha = 1.0;
+
+  /* Text background color */
+  txt->set_bg_clr = 1;
+  txt->text_bg_clr.red = 1.0;
+  txt->text_bg_clr.green = 1.0;
+  txt->text_bg_clr.blue = 1.0;
+  txt->text_bg_clr.alpha = 1.0;
+}
+
+void
+overlay_builder_apply_style(NvDsObjectMeta *obj_meta, OverlayStyleId style_id) {
+  const OverlayStyle *style = &overlay_styles[style_id];
+
+  #ifndef PLATFORM_TEGRA
+    obj_meta->rect_params.has_bg_color = style->has_bg_color;
+    obj_meta->rect_params.bg_color = style->bg_color;
+  #endif
+  obj_meta->rect_params.border_width = style->border_width;
+  obj_meta->rect_params.border_color = style->border_color;
+  obj_meta->text_params.font_params.font_size = style->font_size;
+}
+
+static const std::string *
+intern_label(OverlayBuilder *builder, guint person_count, guint wheelchair_count) {
+  uint64_t key = ((uint64_t) person_count << 32) | wheelchair_count;
+  auto label_it = builder->labels.find(key);
+  if (label_it != builder->labels.end()) {
+    return &label_it->second;
+  }
+
+  if (builder->labels.size() >= OVERLAY_LABEL_CACHE_MAX) {
+    builder->labels.clear();
+    for (auto s_it = builder->sources.begin(); s_it != builder->sources.end(); ++s_it) {
+      s_it->second.label = NULL;
+    }
+  }
+
+  char text[MAX_DISPLAY_LEN];
+  snprintf(text, sizeof(text), "Person = %u Wheelchair = %u ", person_count,
+      wheelchair_count);
+  return &builder->labels.emplace(key, text).first->second;
+}
+
+void
+overlay_builder_add_label(OverlayBuilder *builder, NvDsBatchMeta *batch_meta,
+    NvDsFrameMeta *frame_meta, guint person_count, guint wheelchair_count) {
+  OverlaySourceState &source = builder->sources[frame_meta->source_id];
+  if (!source.label || source.person_count != person_count ||
+      source.wheelchair_count != wheelchair_count) {
+    source.label = intern_label(builder, person_count, wheelchair_count);
+    source.person_count = person_count;
+    source.wheelchair_count = wheelchair_count;
+  }
+
+  NvDsDisplayMeta *display_meta = nvds_acquire_display_meta_from_pool(batch_meta);
+  NvOSD_TextParams *txt_params = &display_meta->text_params[0];
+  *txt_params = builder->label_template;
+
+  // The display meta frees its text when it is released, so it gets its own
+  // copy of the interned label.
+  size_t len = source.label->size() + 1;
+  txt_params->display_text = (char*)g_malloc(len);
+  memcpy(txt_params->display_text, source.label->c_str(), len);
+  display_meta->num_labels = 1;
+
+  nvds_add_display_meta_to_frame(frame_meta, display_meta);
+}
@@ -0,0 +1,59 @@
+#ifndef OVERLAY_BUILDER_H
+#define OVERLAY_BUILDER_H
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <unordered_map>
+
+#include "gstnvdsmeta.h"
+
+/* Builds the OSD overlay from precomputed styles and labels.
+ *
+ * Box styles live in a fixed table and are written to an object's rect and
+ * text params once, after its final status is known. The per-frame count
+ * label is formatted once per distinct pair of counts and interned; each
+ * source remembers the label it showed last, so a frame whose counts did not
+ * change reuses it without a lookup.
+ *
+ * Writes can not be skipped for what did not change since the previous
+ * frame: every buffer carries fresh object metas with the detector's default
+ * style, and a fresh display meta whose text is g_free'd when the meta goes
+ * back to the pool. So each frame still gets one style write per wheelchair
+ * and one copy of the label. overlay-bench compares this against the
+ * previous per-frame formatting. */
+
+enum OverlayStyleId {
+  OVERLAY_STYLE_NEW = 0,
+  OVERLAY_STYLE_ATTENDED,
+  OVERLAY_STYLE_UNATTENDED,
+  OVERLAY_NUM_STYLES
+};
+
+/* Interned labels are dropped all at once if this many accumulate. */
+#define OVERLAY_LABEL_CACHE_MAX 4096
+
+struct OverlaySourceState {
+  guint person_count;
+  guint wheelchair_count;
+  const std::string *label;
+};
+
+struct OverlayBuilder {
+  std::unordered_map<uint64_t, std::string> labels;
+  std::map<guint, OverlaySourceState> sources;
+  NvOSD_TextParams label_template;
+};
+
+void
+overlay_builder_init(OverlayBuilder *builder);
+
+void
+overlay_builder_apply_style(NvDsObjectMeta *obj_meta, OverlayStyleId style);
+
+/* Adds the count label to a frame. */
+void
+overlay_builder_add_label(OverlayBuilder *builder, NvDsBatchMeta *batch_meta,
+    NvDsFrameMeta *frame_meta, guint person_count, guint wheelchair_count);
+
+#endif
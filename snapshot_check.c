@@ -0,0 +1,270 @@
+/* CPU-only check of the snapshot pool.
+ *
+ * Crops are submitted from a synthetic RGBA frame in system memory, with a
+ * row pitch wider than the frame like a real surface. The first snapshot's
+ * output path is a FIFO, so the worker blocks on it and holds its buffer;
+ * that makes the pool run full at a known point. The PNGs are decoded (they
+ * only contain stored deflate blocks) and compared with the frame. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+
+#include <string>
+#include <vector>
+
+#include "check.h"
+#include "snapshot_pool.h"
+
+#define FRAME_WIDTH 320
+#define FRAME_HEIGHT 240
+#define FRAME_PITCH (FRAME_WIDTH * 4 + 64)
+#define MAX_CROP 64
+#define MARGIN 4
+
+static uint8_t
+pixel(int x, int y, int channel) {
+  return (uint8_t) (x * 7 + y * 13 + channel * 61);
+}
+
+static uint32_t
+get_be32(const uint8_t *in) {
+  return ((uint32_t) in[0] << 24) | ((uint32_t) in[1] << 16) |
+         ((uint32_t) in[2] << 8) | in[3];
+}
+
+static bool
+read_file(FILE *file, std::vector<uint8_t>& data) {
+  uint8_t chunk[4096];
+  size_t len;
+  while ((len = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+    data.insert(data.end(), chunk, chunk + len);
+  }
+  return !ferror(file);
+}
+
+/* Decodes a PNG as written by snapshot_write_png into packed RGB. */
+static bool
+decode_png(const std::vector<uint8_t>& png, int *width, int *height,
+    std::vector<uint8_t>& rgb) {
+  static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+  if (png.size() < 8 || memcmp(png.data(), signature, 8) != 0) {
+    return false;
+  }
+
+  std::vector<uint8_t> idat;
+  bool have_header = false, have_end = false;
+  size_t pos = 8;
+  while (pos + 12 <= png.size() && !have_end) {
+    uint32_t len = get_be32(&png[pos]);
+    const char *type = (const char *) &png[pos + 4];
+    const uint8_t *data = &png[pos + 8];
+    if (pos + 12 + len > png.size()) {
+      return false;
+    }
+    if (!memcmp(type, "IHDR", 4) && len == 13) {
+      *width = get_be32(data);
+      *height = get_be32(data + 4);
+      // 8 bit RGB, no interlacing.
+      if (data[8] != 8 || data[9] != 2 || data[12] != 0) {
+        return false;
+      }
+      have_header = true;
+    }
+    else if (!memcmp(type, "IDAT", 4)) {
+      idat.insert(idat.end(), data, data + len);
+    }
+    else if (!memcmp(type, "IEND", 4)) {
+      have_end = true;
+    }
+    pos += 12 + len;
+  }
+  if (!have_header || !have_end || idat.size() < 6) {
+    return false;
+  }
+
+  // zlib header, then stored deflate blocks only.
+  std::vector<uint8_t> raw;
+  pos = 2;
+  bool last = false;
+  while (!last) {
+    if (pos + 5 > idat.size() || (idat[pos] & 0x06) != 0) {
+      return false;
+    }
+    last = idat[pos] & 1;
+    uint16_t len = idat[pos + 1] | (idat[pos + 2] << 8);
+    uint16_t nlen = idat[pos + 3] | (idat[pos + 4] << 8);
+    if ((uint16_t) ~len != nlen || pos + 5 + len > idat.size()) {
+      return false;
+    }
+    raw.insert(raw.end(), &idat[pos + 5], &idat[pos + 5] + len);
+    pos += 5 + len;
+  }
+
+  uint32_t adler_a = 1, adler_b = 0;
+  for (size_t i = 0; i < raw.size(); i++) {
+    adler_a = (adler_a + raw[i]) % 65521;
+    adler_b = (adler_b + adler_a) % 65521;
+  }
+  if (pos + 4 > idat.size() || get_be32(&idat[pos]) != ((adler_b << 16) | adler_a)) {
+    return false;
+  }
+
+  size_t row_len = (size_t) *width * 3 + 1;
+  if (raw.size() != row_len * *height) {
+    return false;
+  }
+  rgb.clear();
+  for (int row = 0; row < *height; row++) {
+    const uint8_t *line = &raw[row * row_len];
+    if (line[0] != 0) {
+      return false;
+    }
+    rgb.insert(rgb.end(), line + 1, line + row_len);
+  }
+  return true;
+}
+
+/* Checks a decoded snapshot against the (left, top, w, h) area of the frame. */
+static void
+check_png(const std::vector<uint8_t>& png, int left, int top, int w, int h) {
+  int width = 0, height = 0;
+  std::vector<uint8_t> rgb;
+  CHECK(decode_png(png, &width, &height, rgb));
+  CHECK(width == w);
+  CHECK(height == h);
+  if (width != w || height != h || rgb.size() != (size_t) w * h * 3) {
+    return;
+  }
+
+  int mismatches = 0;
+  for (int y = 0; y < h; y++) {
+    for (int x = 0; x < w; x++) {
+      for (int c = 0; c < 3; c++) {
+        if (rgb[(y * w + x) * 3 + c] != pixel(left + x, top + y, c)) {
+          mismatches++;
+        }
+      }
+    }
+  }
+  CHECK(mismatches == 0);
+}
+
+static void
+check_png_file(const std::string& path, int left, int top, int w, int h) {
+  std::vector<uint8_t> png;
+  FILE *file = fopen(path.c_str(), "rb");
+  CHECK(file != NULL);
+  if (!file) {
+    return;
+  }
+  CHECK(read_file(file, png));
+  fclose(file);
+  check_png(png, left, top, w, h);
+}
+
+int
+main() {
+  std::vector<uint8_t> frame((size_t) FRAME_PITCH * FRAME_HEIGHT, 0xee);
+  for (int y = 0; y < FRAME_HEIGHT; y++) {
+    for (int x = 0; x < FRAME_WIDTH; x++) {
+      uint8_t *px = &frame[(size_t) y * FRAME_PITCH + x * 4];
+      px[0] = pixel(x, y, 0);
+      px[1] = pixel(x, y, 1);
+      px[2] = pixel(x, y, 2);
+      px[3] = 0xff;
+    }
+  }
+
+  char dir[] = "/tmp/snapshot-check-XXXXXX";
+  if (!mkdtemp(dir)) {
+    perror("mkdtemp");
+    return 1;
+  }
+  std::string blocked = std::string(dir) + "/src0_trk1_pts100.png";
+  std::string queued = std::string(dir) + "/src0_trk2_pts100.png";
+  std::string clipped = std::string(dir) + "/src1_trk3_pts200.png";
+  if (mkfifo(blocked.c_str(), 0600) != 0) {
+    perror("mkfifo");
+    return 1;
+  }
+
+  SnapshotPool *pool = snapshot_pool_create(dir, 2, MAX_CROP, MAX_CROP);
+  CHECK(pool != NULL);
+  if (!pool) {
+    return 1;
+  }
+  SnapshotStats stats;
+
+  // Taken by the worker, which then blocks opening the FIFO.
+  CHECK(snapshot_pool_submit(pool, frame.data(), FRAME_WIDTH, FRAME_HEIGHT,
+      FRAME_PITCH, 40, 30, 20, 24, MARGIN, 0, 1, 100));
+  // Sits in the second buffer.
+  CHECK(snapshot_pool_submit(pool, frame.data(), FRAME_WIDTH, FRAME_HEIGHT,
+      FRAME_PITCH, 100, 50, 10, 12, MARGIN, 0, 2, 100));
+  // No buffer left.
+  CHECK(!snapshot_pool_submit(pool, frame.data(), FRAME_WIDTH, FRAME_HEIGHT,
+      FRAME_PITCH, 0, 0, 10, 10, MARGIN, 0, 9, 100));
+  CHECK(!snapshot_pool_submit(pool, frame.data(), FRAME_WIDTH, FRAME_HEIGHT,
+      FRAME_PITCH, 0, 0, 10, 10, MARGIN, 0, 9, 100));
+  // Outside the frame and a NULL frame are bad crops, whatever the pool level.
+  CHECK(!snapshot_pool_submit(pool, frame.data(), FRAME_WIDTH, FRAME_HEIGHT,
+      FRAME_PITCH, FRAME_WIDTH + 10, 0, 10, 10, 0, 0, 9, 100));
+  CHECK(!snapshot_pool_submit(pool, NULL, FRAME_WIDTH, FRAME_HEIGHT,
+      FRAME_PITCH, 0, 0, 10, 10, 0, 0, 9, 100));
+
+  snapshot_pool_get_stats(pool, &stats);
+  CHECK(stats.submitted == 6);
+  CHECK(stats.dropped_pool_full == 2);
+  CHECK(stats.dropped_bad_crop == 2);
+  CHECK(stats.written == 0);
+
+  snapshot_pool_drop_not_visible(pool);
+  snapshot_pool_get_stats(pool, &stats);
+  CHECK(stats.dropped_not_visible == 1);
+  CHECK(stats.submitted == 6);
+
+  // Unblock the worker and read the first snapshot from the FIFO.
+  FILE *fifo = fopen(blocked.c_str(), "rb");
+  CHECK(fifo != NULL);
+  if (fifo) {
+    std::vector<uint8_t> png;
+    CHECK(read_file(fifo, png));
+    fclose(fifo);
+    check_png(png, 40 - MARGIN, 30 - MARGIN, 20 + 2 * MARGIN, 24 + 2 * MARGIN);
+  }
+
+  // Wait for the worker to write the queued snapshot and free both buffers.
+  for (int i = 0; i < 1000; i++) {
+    snapshot_pool_get_stats(pool, &stats);
+    if (stats.written + stats.write_failed == 2) {
+      break;
+    }
+    usleep(1000);
+  }
+  CHECK(stats.written == 2);
+
+  // Clipped to the frame on the top left and to MAX_CROP on the bottom right.
+  CHECK(snapshot_pool_submit(pool, frame.data(), FRAME_WIDTH, FRAME_HEIGHT,
+      FRAME_PITCH, 2, 1, 100, 100, MARGIN, 1, 3, 200));
+
+  // Destroying the pool drains what is still queued, and the final stats
+  // include it.
+  snapshot_pool_destroy(pool, &stats);
+  CHECK(stats.submitted == 7);
+  CHECK(stats.written == 3);
+  CHECK(stats.write_failed == 0);
+
+  check_png_file(queued, 100 - MARGIN, 50 - MARGIN, 10 + 2 * MARGIN, 12 + 2 * MARGIN);
+  check_png_file(clipped, 0, 0, MAX_CROP, MAX_CROP);
+
+  unlink(blocked.c_str());
+  unlink(queued.c_str());
+  unlink(clipped.c_str());
+  rmdir(dir);
+
+  return check_result("snapshot-check");
+}
@@ -0,0 +1,288 @@
+#include "snapshot_pool.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdio.h>
+#include <string.h>
+
+struct SnapshotJob {
+  std::vector<uint8_t> rgb;
+  int width, height;
+  uint32_t source_id;
+  int tracker_id;
+  uint64_t pts;
+};
+
+struct SnapshotPool {
+  std::string dir;
+  int max_width, max_height;
+
+  std::vector<SnapshotJob> jobs;
+  std::vector<SnapshotJob *> free_jobs;
+  std::deque<SnapshotJob *> pending;
+  std::mutex lock;
+  std::condition_variable cond;
+  bool stop;
+  std::thread worker;
+
+  SnapshotStats stats;
+};
+
+static void
+snapshot_worker(SnapshotPool *pool) {
+  char path[512];
+  std::unique_lock<std::mutex> guard(pool->lock);
+  for (;;) {
+    pool->cond.wait(guard, [pool] { return pool->stop || !pool->pending.empty(); });
+    if (pool->pending.empty()) {
+      break;
+    }
+
+    SnapshotJob *job = pool->pending.front();
+    pool->pending.pop_front();
+    guard.unlock();
+
+    snprintf(path, sizeof(path), "%s/src%u_trk%d_pts%llu.png",
+        pool->dir.c_str(), job->source_id, job->tracker_id,
+        (unsigned long long) job->pts);
+    bool ok = snapshot_write_png(path, job->rgb.data(), job->width, job->height);
+
+    guard.lock();
+    if (ok) {
+      pool->stats.written++;
+    }
+    else {
+      pool->stats.write_failed++;
+    }
+    pool->free_jobs.push_back(job);
+  }
+}
+
+SnapshotPool *
+snapshot_pool_create(const char *dir, int num_buffers, int max_width,
+    int max_height) {
+  if (num_buffers <= 0 || max_width <= 0 || max_height <= 0) {
+    return NULL;
+  }
+
+  SnapshotPool *pool = new SnapshotPool();
+  pool->dir = dir;
+  pool->max_width = max_width;
+  pool->max_height = max_height;
+  pool->stop = false;
+  memset(&pool->stats, 0, sizeof(pool->stats));
+
+  // All the memory the pool will ever use is allocated here.
+  pool->jobs.resize(num_buffers);
+  for (auto j_it = pool->jobs.begin(); j_it != pool->jobs.end(); ++j_it) {
+    (*j_it).rgb.resize((size_t) max_width * max_height * 3);
+    pool->free_jobs.push_back(&(*j_it));
+  }
+
+  pool->worker = std::thread(snapshot_worker, pool);
+  return pool;
+}
+
+bool
+snapshot_pool_submit(SnapshotPool *pool, const uint8_t *frame, int frame_width,
+    int frame_height, int pitch, int x, int y, int w, int h, int margin,
+    uint32_t source_id, int tracker_id, uint64_t pts) {
+  int left = std::max(x - margin, 0);
+  int top = std::max(y - margin, 0);
+  int right = std::min(x + w + margin, frame_width);
+  int bottom = std::min(y + h + margin, frame_height);
+  // Oversized boxes keep their top left corner and lose the rest.
+  right = std::min(right, left + pool->max_width);
+  bottom = std::min(bottom, top + pool->max_height);
+
+  SnapshotJob *job = NULL;
+  {
+    std::lock_guard<std::mutex> guard(pool->lock);
+    pool->stats.submitted++;
+    if (!frame || right <= left || bottom <= top) {
+      pool->stats.dropped_bad_crop++;
+      return false;
+    }
+    if (pool->free_jobs.empty()) {
+      pool->stats.dropped_pool_full++;
+      return false;
+    }
+    job = pool->free_jobs.back();
+    pool->free_jobs.pop_back();
+  }
+
+  job->width = right - left;
+  job->height = bottom - top;
+  job->source_id = source_id;
+  job->tracker_id = tracker_id;
+  job->pts = pts;
+
+  uint8_t *dst = job->rgb.data();
+  for (int row = top; row < bottom; row++) {
+    const uint8_t *src = frame + (size_t) row * pitch + (size_t) left * 4;
+    for (int col = 0; col < job->width; col++) {
+      dst[0] = src[0];
+      dst[1] = src[1];
+      dst[2] = src[2];
+      dst += 3;
+      src += 4;
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(pool->lock);
+    pool->pending.push_back(job);
+  }
+  pool->cond.notify_one();
+  return true;
+}
+
+void
+snapshot_pool_drop_not_visible(SnapshotPool *pool) {
+  std::lock_guard<std::mutex> guard(pool->lock);
+  pool->stats.dropped_not_visible++;
+}
+
+void
+snapshot_pool_get_stats(SnapshotPool *pool, SnapshotStats *stats) {
+  std::lock_guard<std::mutex> guard(pool->lock);
+  *stats = pool->stats;
+}
+
+void
+snapshot_pool_destroy(SnapshotPool *pool, SnapshotStats *final_stats) {
+  if (!pool) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(pool->lock);
+    pool->stop = true;
+  }
+  pool->cond.notify_one();
+  pool->worker.join();
+  if (final_stats) {
+    *final_stats = pool->stats;
+  }
+  delete pool;
+}
+
+/* PNG encoding. The image data is wrapped in stored (uncompressed) deflate
+ * blocks so no compression library is needed. */
+
+static uint32_t crc_table[256];
+
+static void
+init_crc_table() {
+  for (uint32_t n = 0; n < 256; n++) {
+    uint32_t c = n;
+    for (int k = 0; k < 8; k++) {
+      c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+    }
+    crc_table[n] = c;
+  }
+}
+
+static uint32_t
+update_crc(uint32_t crc, const uint8_t *data, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    crc = crc_table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+  }
+  return crc;
+}
+
+static void
+put_be32(uint8_t *out, uint32_t value) {
+  out[0] = value >> 24;
+  out[1] = value >> 16;
+  out[2] = value >> 8;
+  out[3] = value;
+}
+
+static bool
+write_chunk(FILE *file, const char *type, const uint8_t *data, size_t len) {
+  uint8_t header[8];
+  uint8_t trailer[4];
+  put_be32(header, len);
+  memcpy(header + 4, type, 4);
+  uint32_t crc = update_crc(0xffffffffu, header + 4, 4);
+  crc = update_crc(crc, data, len) ^ 0xffffffffu;
+  put_be32(trailer, crc);
+
+  return fwrite(header, 1, 8, file) == 8 &&
+         (len == 0 || fwrite(data, 1, len, file) == len) &&
+         fwrite(trailer, 1, 4, file) == 4;
+}
+
+bool
+snapshot_write_png(const char *path, const uint8_t *rgb, int width, int height) {
+  static std::once_flag crc_once;
+  std::call_once(crc_once, init_crc_table);
+
+  // Each scanline is prefixed with filter type 0 (none).
+  size_t row_len = (size_t) width * 3 + 1;
+  size_t raw_len = row_len * height;
+  size_t num_blocks = (raw_len + 65534) / 65535;
+  std::vector<uint8_t> idat;
+  idat.reserve(2 + num_blocks * 5 + raw_len + 4);
+
+  idat.push_back(0x78);
+  idat.push_back(0x01);
+
+  uint32_t adler_a = 1, adler_b = 0;
+  size_t block_left = 0;
+  size_t remaining = raw_len;
+  for (int row = 0; row < height; row++) {
+    const uint8_t *line = rgb + (size_t) row * width * 3;
+    for (size_t i = 0; i < row_len; i++) {
+      if (block_left == 0) {
+        block_left = std::min<size_t>(remaining, 65535);
+        remaining -= block_left;
+        idat.push_back(remaining == 0 ? 1 : 0);
+        idat.push_back(block_left & 0xff);
+        idat.push_back(block_left >> 8);
+        idat.push_back(~block_left & 0xff);
+        idat.push_back((~block_left >> 8) & 0xff);
+      }
+      uint8_t byte = i == 0 ? 0 : line[i - 1];
+      idat.push_back(byte);
+      adler_a = (adler_a + byte) % 65521;
+      adler_b = (adler_b + adler_a) % 65521;
+      block_left--;
+    }
+  }
+
+  uint8_t adler[4];
+  put_be32(adler, (adler_b << 16) | adler_a);
+  idat.insert(idat.end(), adler, adler + 4);
+
+  uint8_t ihdr[13];
+  put_be32(ihdr, width);
+  put_be32(ihdr + 4, height);
+  ihdr[8] = 8;   // bit depth
+  ihdr[9] = 2;   // colour type RGB
+  ihdr[10] = 0;  // compression
+  ihdr[11] = 0;  // filter
+  ihdr[12] = 0;  // interlace
+
+  static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+
+  FILE *file = fopen(path, "wb");
+  if (!file) {
+    return false;
+  }
+  bool ok = fwrite(signature, 1, 8, file) == 8 &&
+            write_chunk(file, "IHDR", ihdr, sizeof(ihdr)) &&
+            write_chunk(file, "IDAT", idat.data(), idat.size()) &&
+            write_chunk(file, "IEND", NULL, 0);
+  if (fclose(file) != 0) {
+    ok = false;
+  }
+  return ok;
+}
@@ -0,0 +1,56 @@
+#ifndef SNAPSHOT_POOL_H
+#define SNAPSHOT_POOL_H
+
+#include <stdint.h>
+
+/* Event snapshots copied out of the frame into a preallocated buffer pool.
+ *
+ * The streaming thread only copies the crop into a free buffer, which is
+ * bounded by the pool's maximum crop size, and hands it to a worker thread
+ * that encodes it to PNG and writes it out. When every buffer is still queued
+ * the snapshot is dropped and counted instead of waiting for the worker. */
+
+struct SnapshotPool;
+
+struct SnapshotStats {
+  uint64_t submitted;
+  uint64_t written;
+  uint64_t dropped_pool_full;
+  uint64_t dropped_bad_crop;
+  // Events whose object was not detected again before it could be cropped.
+  uint64_t dropped_not_visible;
+  uint64_t write_failed;
+};
+
+SnapshotPool *
+snapshot_pool_create(const char *dir, int num_buffers, int max_width,
+    int max_height);
+
+/* Copies the (x, y, w, h) box, grown by `margin` on every side and clipped to
+ * the frame and to the pool's maximum crop size, out of a packed RGBA frame
+ * in CPU memory. Returns false if the snapshot was dropped, a NULL frame
+ * counts as a bad crop. */
+bool
+snapshot_pool_submit(SnapshotPool *pool, const uint8_t *frame, int frame_width,
+    int frame_height, int pitch, int x, int y, int w, int h, int margin,
+    uint32_t source_id, int tracker_id, uint64_t pts);
+
+/* Counts a snapshot the caller gave up on because the object was not in
+ * view. */
+void
+snapshot_pool_drop_not_visible(SnapshotPool *pool);
+
+void
+snapshot_pool_get_stats(SnapshotPool *pool, SnapshotStats *stats);
+
+/* Writes out whatever is still queued, then stops the worker. If
+ * `final_stats` is not NULL it receives the stats once everything queued has
+ * been written. */
+void
+snapshot_pool_destroy(SnapshotPool *pool, SnapshotStats *final_stats);
+
+/* Encodes packed RGB rows as an uncompressed PNG file. */
+bool
+snapshot_write_png(const char *path, const uint8_t *rgb, int width, int height);
+
+#endif
@@ -0,0 +1,146 @@
+/* Benchmark of zone classification.
+ *
+ * Classifies the same random foot points once through a rasterised zone mask
+ * and once by testing every zone polygon in turn, the way a per-detection
+ * point in polygon check would, for a growing number of zones. Zones are
+ * octagons tiled over the muxer frame. The two methods disagree only on
+ * points within a mask cell of a zone edge, the share of those is printed
+ * alongside the timings. */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "zone_mask.h"
+
+#define FRAME_WIDTH 1920
+#define FRAME_HEIGHT 1080
+#define ZONE_VERTICES 8
+
+static std::vector<std::vector<ZonePoint>>
+make_zones(int num_zones) {
+  int cols = (int) ceil(sqrt((double) num_zones * FRAME_WIDTH / FRAME_HEIGHT));
+  int rows = (num_zones + cols - 1) / cols;
+  int tile_w = FRAME_WIDTH / cols;
+  int tile_h = FRAME_HEIGHT / rows;
+
+  std::vector<std::vector<ZonePoint>> zones;
+  for (int i = 0; i < num_zones; i++) {
+    int cx = (i % cols) * tile_w + tile_w / 2;
+    int cy = (i / cols) * tile_h + tile_h / 2;
+    std::vector<ZonePoint> polygon;
+    for (int v = 0; v < ZONE_VERTICES; v++) {
+      double angle = 2 * M_PI * v / ZONE_VERTICES;
+      polygon.push_back({cx + (int) (0.45 * tile_w * cos(angle)),
+          cy + (int) (0.45 * tile_h * sin(angle))});
+    }
+    zones.push_back(polygon);
+  }
+  return zones;
+}
+
+static double
+elapsed_ns(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::nano>(
+      std::chrono::steady_clock::now() - start).count();
+}
+
+static void
+usage(const char *app) {
+  fprintf(stderr, "Usage: %s [-n <points>] [-r <rounds>]\n", app);
+}
+
+int
+main(int argc, char *argv[]) {
+  int num_points = 100000;
+  int rounds = 5;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:r:")) != -1) {
+    switch (opt) {
+      case 'n':
+        num_points = atoi(optarg);
+        break;
+      case 'r':
+        rounds = atoi(optarg);
+        break;
+      default:
+        usage(argv[0]);
+        return -1;
+    }
+  }
+  if (num_points <= 0 || rounds <= 0) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<int> dist_x(0, FRAME_WIDTH - 1);
+  std::uniform_int_distribution<int> dist_y(0, FRAME_HEIGHT - 1);
+  std::vector<ZonePoint> points(num_points);
+  for (auto p_it = points.begin(); p_it != points.end(); ++p_it) {
+    (*p_it).x = dist_x(rng);
+    (*p_it).y = dist_y(rng);
+  }
+
+  static const int zone_counts[] = { 1, 4, 16, 64 };
+  std::vector<int> mask_ids(num_points), polygon_ids(num_points);
+
+  printf("%d points, %d rounds, %dx%d frame, %d px cells\n", num_points, rounds,
+      FRAME_WIDTH, FRAME_HEIGHT, ZONE_MASK_CELL_SIZE);
+  printf("%6s %12s %14s %14s %9s %10s\n", "zones", "build ms", "mask ns/pt",
+      "polygon ns/pt", "speedup", "mismatch");
+
+  for (size_t z = 0; z < sizeof(zone_counts) / sizeof(zone_counts[0]); z++) {
+    std::vector<std::vector<ZonePoint>> zones = make_zones(zone_counts[z]);
+
+    auto start = std::chrono::steady_clock::now();
+    ZoneMask mask;
+    zone_mask_init(&mask, FRAME_WIDTH, FRAME_HEIGHT, ZONE_MASK_CELL_SIZE);
+    for (size_t i = 0; i < zones.size(); i++) {
+      zone_mask_add_polygon(&mask, i + 1, zones[i]);
+    }
+    double build_ns = elapsed_ns(start);
+
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) {
+      for (int i = 0; i < num_points; i++) {
+        mask_ids[i] = zone_mask_lookup(&mask, points[i].x, points[i].y);
+      }
+    }
+    double mask_ns = elapsed_ns(start) / ((double) rounds * num_points);
+
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) {
+      for (int i = 0; i < num_points; i++) {
+        int zone_id = ZONE_NONE;
+        for (size_t k = 0; k < zones.size(); k++) {
+          if (zone_point_in_polygon(zones[k], points[i].x, points[i].y)) {
+            zone_id = k + 1;
+            break;
+          }
+        }
+        polygon_ids[i] = zone_id;
+      }
+    }
+    double polygon_ns = elapsed_ns(start) / ((double) rounds * num_points);
+
+    int mismatches = 0;
+    for (int i = 0; i < num_points; i++) {
+      if (mask_ids[i] != polygon_ids[i]) {
+        mismatches++;
+      }
+    }
+
+    printf("%6d %12.2f %14.2f %14.2f %8.1fx %9.2f%%\n", zone_counts[z],
+        build_ns / 1e6, mask_ns, polygon_ns, polygon_ns / mask_ns,
+        100.0 * mismatches / num_points);
+  }
+
+  return 0;
+}
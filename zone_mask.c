@@ -0,0 +1,64 @@
+#include "zone_mask.h"
+
+void
+zone_mask_init(ZoneMask *mask, int frame_width, int frame_height, int cell_size) {
+  mask->cell_size = cell_size;
+  mask->width = (frame_width + cell_size - 1) / cell_size;
+  mask->height = (frame_height + cell_size - 1) / cell_size;
+  mask->cells.assign((size_t) mask->width * mask->height, ZONE_NONE);
+}
+
+bool
+zone_mask_add_polygon(ZoneMask *mask, int zone_id,
+    const std::vector<ZonePoint>& polygon) {
+  if (zone_id <= ZONE_NONE || zone_id > ZONE_MAX_ID || polygon.size() < 3) {
+    return false;
+  }
+
+  // Only the cells inside the polygon's bounding box can be covered.
+  int min_x = polygon[0].x, max_x = polygon[0].x;
+  int min_y = polygon[0].y, max_y = polygon[0].y;
+  for (auto p_it = polygon.begin(); p_it != polygon.end(); ++p_it) {
+    if ((*p_it).x < min_x) min_x = (*p_it).x;
+    if ((*p_it).x > max_x) max_x = (*p_it).x;
+    if ((*p_it).y < min_y) min_y = (*p_it).y;
+    if ((*p_it).y > max_y) max_y = (*p_it).y;
+  }
+
+  int cx0 = min_x < 0 ? 0 : min_x / mask->cell_size;
+  int cy0 = min_y < 0 ? 0 : min_y / mask->cell_size;
+  int cx1 = max_x / mask->cell_size;
+  int cy1 = max_y / mask->cell_size;
+  if (cx1 >= mask->width) cx1 = mask->width - 1;
+  if (cy1 >= mask->height) cy1 = mask->height - 1;
+
+  for (int cy = cy0; cy <= cy1; cy++) {
+    for (int cx = cx0; cx <= cx1; cx++) {
+      uint8_t &cell = mask->cells[cy * mask->width + cx];
+      if (cell != ZONE_NONE) {
+        continue;
+      }
+      float px = (cx + 0.5f) * mask->cell_size;
+      float py = (cy + 0.5f) * mask->cell_size;
+      if (zone_point_in_polygon(polygon, px, py)) {
+        cell = (uint8_t) zone_id;
+      }
+    }
+  }
+  return true;
+}
+
+bool
+zone_point_in_polygon(const std::vector<ZonePoint>& polygon, float x, float y) {
+  bool inside = false;
+  size_t n = polygon.size();
+  for (size_t i = 0, j = n - 1; i < n; j = i++) {
+    const ZonePoint &a = polygon[i];
+    const ZonePoint &b = polygon[j];
+    if (((a.y > y) != (b.y > y)) &&
+        (x < (float) (b.x - a.x) * (y - a.y) / (float) (b.y - a.y) + a.x)) {
+      inside = !inside;
+    }
+  }
+  return inside;
+}
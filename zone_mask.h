@@ -0,0 +1,57 @@
+#ifndef ZONE_MASK_H
+#define ZONE_MASK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/* Region-of-interest zones rasterised into a low resolution lookup mask.
+ *
+ * Each polygon is tested against the centre of every mask cell once, when it
+ * is added. After that a detection is classified by indexing the cell its
+ * point falls in, which costs the same whatever the number or shape of the
+ * zones. Where zones overlap the one added first wins. */
+
+#define ZONE_NONE 0
+#define ZONE_MAX_ID 255
+
+/* Side of a mask cell in muxer pixels. */
+#define ZONE_MASK_CELL_SIZE 8
+
+struct ZonePoint {
+  int x, y;
+};
+
+struct ZoneMask {
+  int width, height;
+  int cell_size;
+  std::vector<uint8_t> cells;
+};
+
+void
+zone_mask_init(ZoneMask *mask, int frame_width, int frame_height, int cell_size);
+
+bool
+zone_mask_add_polygon(ZoneMask *mask, int zone_id,
+    const std::vector<ZonePoint>& polygon);
+
+/* Zone id of the cell containing (x, y), ZONE_NONE outside every zone or
+ * outside the frame. */
+static inline int
+zone_mask_lookup(const ZoneMask *mask, int x, int y) {
+  if (x < 0 || y < 0) {
+    return ZONE_NONE;
+  }
+  int cx = x / mask->cell_size;
+  int cy = y / mask->cell_size;
+  if (cx >= mask->width || cy >= mask->height) {
+    return ZONE_NONE;
+  }
+  return mask->cells[cy * mask->width + cx];
+}
+
+/* Even-odd point in polygon test, used to rasterise the mask. */
+bool
+zone_point_in_polygon(const std::vector<ZonePoint>& polygon, float x, float y);
+
+#endif